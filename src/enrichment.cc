@@ -4,6 +4,8 @@
 #include <algorithm>
 #include <cmath>
 #include <limits>
+#include <map>
+#include <set>
 #include <sstream>
 #include <vector>
 
@@ -13,6 +15,95 @@ using cyclus::Material;
 
 namespace cycamore {
 
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+EnrichmentCosts::EnrichmentCosts(double feed, double tails)
+    : feed_(feed),
+      tails_(tails),
+      v_feed_(cyclus::toolkit::ValueFunc(feed)),
+      v_tails_(cyclus::toolkit::ValueFunc(tails)) {}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+void EnrichmentCosts::Add(Material::Ptr m) {
+  int id = m->comp()->id();
+  if (costs_.count(id) == 0) {
+    costs_[id] = Compute(m);
+  }
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+EnrichmentCosts::Costs EnrichmentCosts::Get(Material::Ptr m) const {
+  std::map<int, Costs>::const_iterator it = costs_.find(m->comp()->id());
+  if (it != costs_.end()) {
+    return it->second;
+  }
+  return Compute(m);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+EnrichmentCosts::Costs EnrichmentCosts::Compute(Material::Ptr m) const {
+  // same as toolkit::SwuRequired and toolkit::FeedQty for 1 kg of product,
+  // reusing the feed and tails value functions
+  double product = cyclus::toolkit::UraniumAssayMass(m);
+  double feed_qty = (product - tails_) / (feed_ - tails_);
+  double tails_qty = feed_qty - 1;
+
+  cyclus::toolkit::MatQuery mq(m);
+  std::set<cyclus::Nuc> nucs;
+  nucs.insert(922350000);
+  nucs.insert(922380000);
+
+  Costs c;
+  c.swu = cyclus::toolkit::ValueFunc(product) + tails_qty * v_tails_ -
+          feed_qty * v_feed_;
+  c.natu = feed_qty / mq.mass_frac(nucs);
+  return c;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+double OptimalTailsAssay(double feed_assay, double product_assay,
+                         double feed_qty, double swu, double lo, double hi) {
+  using cyclus::toolkit::Assays;
+  using cyclus::toolkit::FeedQty;
+  using cyclus::toolkit::SwuRequired;
+
+  // tails must stay below both the feed and product assays
+  double top = std::min(feed_assay, product_assay);
+  hi = std::min(hi, top * (1 - 1e-9));
+  if (lo >= hi) {
+    return std::min(lo, hi);
+  }
+
+  // product deliverable from the feed falls and product deliverable from the
+  // SWU rises as the tails assay increases, so the best tails assay is
+  // where they cross (or a bound if they don't)
+  double diff_lo, diff_hi;
+  {
+    Assays a(feed_assay, product_assay, lo);
+    diff_lo = feed_qty * SwuRequired(1, a) - swu * FeedQty(1, a);
+  }
+  if (diff_lo <= 0) {
+    return lo;  // feed limited everywhere
+  }
+  {
+    Assays a(feed_assay, product_assay, hi);
+    diff_hi = feed_qty * SwuRequired(1, a) - swu * FeedQty(1, a);
+  }
+  if (diff_hi >= 0) {
+    return hi;  // SWU limited everywhere
+  }
+
+  for (int i = 0; i < 100 && hi - lo > 1e-12; i++) {
+    double mid = 0.5 * (lo + hi);
+    Assays a(feed_assay, product_assay, mid);
+    if (feed_qty * SwuRequired(1, a) - swu * FeedQty(1, a) > 0) {
+      lo = mid;
+    } else {
+      hi = mid;
+    }
+  }
+  return 0.5 * (lo + hi);
+}
+
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 Enrichment::Enrichment(cyclus::Context* ctx)
     : cyclus::Facility(ctx),
@@ -24,7 +115,20 @@ Enrichment::Enrichment(cyclus::Context* ctx)
       feed_recipe(""),
       product_commod(""),
       tails_commod(""),
-      order_prefs(true) {}
+      order_prefs(true),
+      tails_band(0),
+      pref_assay_bucket(0),
+      aggregate_records(false),
+      record_trades(false),
+      optimize_tails(false),
+      min_tails_assay(0.001),
+      max_tails_assay(0.003),
+      optimal_tails_assay_(0),
+      intra_timestep_swu_(0),
+      intra_timestep_feed_(0),
+      intra_timestep_product_(0),
+      intra_timestep_tails_(0),
+      feed_totals_synced_(false) {}
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 Enrichment::~Enrichment() {}
@@ -47,6 +151,7 @@ void Enrichment::Build(cyclus::Agent* parent) {
   if (initial_feed > 0) {
     inventory.Push(Material::Create(this, initial_feed,
                                     context()->GetRecipe(feed_recipe)));
+    feed_totals_synced_ = false;
   }
 
   LOG(cyclus::LEV_DEBUG2, "EnrFac") << "Enrichment "
@@ -57,12 +162,28 @@ void Enrichment::Build(cyclus::Agent* parent) {
 void Enrichment::EnterNotify() {
   cyclus::Facility::EnterNotify();
   InitializePosition();
+
+  if (optimize_tails &&
+      (min_tails_assay <= 0 || min_tails_assay > max_tails_assay ||
+       max_tails_assay >= 1)) {
+    std::stringstream ss;
+    ss << "prototype '" << prototype() << "' has invalid tails assay bounds ["
+       << min_tails_assay << ", " << max_tails_assay
+       << "], they must satisfy 0 < min_tails_assay <= max_tails_assay < 1";
+    throw cyclus::ValidationError(ss.str());
+  }
 }
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 void Enrichment::Tick() {
   current_swu_capacity = SwuCapacity();
+  optimal_tails_assay_ = 0;
 
+  // reset here rather than when trading, so steps without trades record zero
+  intra_timestep_swu_ = 0;
+  intra_timestep_feed_ = 0;
+  intra_timestep_product_ = 0;
+  intra_timestep_tails_ = 0;
 }
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
@@ -75,6 +196,12 @@ void Enrichment::Tock() {
                                    << intra_timestep_feed_ << " feed";
   RecordTimeSeries<cyclus::toolkit::ENRICH_FEED>(this, intra_timestep_feed_);
   RecordTimeSeries<double>("demand"+feed_commod, this, intra_timestep_feed_);
+  if (optimize_tails) {
+    RecordTimeSeries<double>("TailsAssay", this, TailsAssay());
+  }
+  if (aggregate_records) {
+    RecordEnrichmentTotals_();
+  }
 }
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
@@ -96,17 +223,12 @@ Enrichment::GetMatlRequests() {
 }
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
-bool SortBids(cyclus::Bid<Material>* i,
-              cyclus::Bid<Material>* j) {
-  Material::Ptr mat_i = i->offer();
-  Material::Ptr mat_j = j->offer();
-
-  cyclus::toolkit::MatQuery mq_i(mat_i);
-  cyclus::toolkit::MatQuery mq_j(mat_j);
+typedef std::pair<double, cyclus::Bid<Material>*> AssayKey;
 
-  return ((mq_i.mass(922350000) / mq_i.qty()) <=
-          (mq_j.mass(922350000) / mq_j.qty()));
+bool SortAssayKeys(const AssayKey& i, const AssayKey& j) {
+  return i.first < j.first;
 }
+
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 // Sort offers of input material to have higher preference for more
 //  U-235 content
@@ -118,36 +240,52 @@ void Enrichment::AdjustMatlPrefs(
     return;
   }
 
+  // the same offers are usually bid against every request, so the U-235
+  // mass fraction of each offered composition is only computed once
+  std::map<int, double> assays;
   cyclus::PrefMap<Material>::type::iterator reqit;
 
   // Loop over all requests
   for (reqit = prefs.begin(); reqit != prefs.end(); ++reqit) {
-    std::vector<Bid<Material>*> bids_vector;
+    std::vector<AssayKey> keys;
+    keys.reserve(reqit->second.size());
     std::map<Bid<Material>*, double>::iterator mit;
     for (mit = reqit->second.begin(); mit != reqit->second.end(); ++mit) {
       Bid<Material>* bid = mit->first;
-      bids_vector.push_back(bid);
+      Material::Ptr mat = bid->offer();
+      int comp_id = mat->comp()->id();
+      std::map<int, double>::iterator ait = assays.find(comp_id);
+      if (ait == assays.end()) {
+        cyclus::toolkit::MatQuery mq(mat);
+        ait = assays.insert(
+            std::make_pair(comp_id, mq.mass_frac(922350000))).first;
+      }
+      keys.push_back(std::make_pair(ait->second, bid));
     }
-    std::sort(bids_vector.begin(), bids_vector.end(), SortBids);
 
-    // Assign preferences to the sorted vector
-    double n_bids = bids_vector.size();
-    bool u235_mass = 0;
+    if (pref_assay_bucket > 0) {
+      // Assign preferences by assay bucket, so bids of similar assay share a
+      // preference and the prefs do not change as offers come and go
+      for (int i = 0; i < keys.size(); i++) {
+        double new_pref = -1;  // no U-235
+        if (keys[i].first > 0) {
+          new_pref = std::floor(keys[i].first / pref_assay_bucket) + 1;
+        }
+        (reqit->second)[keys[i].second] = new_pref;
+      }
+      continue;
+    }
 
-    for (int bidit = 0; bidit < bids_vector.size(); bidit++) {
-      int new_pref = bidit + 1;
+    std::stable_sort(keys.begin(), keys.end(), SortAssayKeys);
 
-      // For any bids with U-235 qty=0, set pref to zero.
-      if (!u235_mass) {
-        Material::Ptr mat = bids_vector[bidit]->offer();
-        cyclus::toolkit::MatQuery mq(mat);
-        if (mq.mass(922350000) == 0) {
-          new_pref = -1;
-        } else {
-          u235_mass = true;
-        }
+    // Assign preferences to the sorted vector.
+    // For any bids with U-235 qty=0, set pref to -1.
+    for (int bidit = 0; bidit < keys.size(); bidit++) {
+      int new_pref = bidit + 1;
+      if (keys[bidit].first <= 0) {
+        new_pref = -1;
       }
-      (reqit->second)[bids_vector[bidit]] = new_pref;
+      (reqit->second)[keys[bidit].second] = new_pref;
     }  // each bid
   }    // each Material Request
 }
@@ -182,14 +320,16 @@ std::set<cyclus::BidPortfolio<Material>::Ptr> Enrichment::GetMatlBids(
   if ((out_requests.count(tails_commod) > 0) && (tails.quantity() > 0)) {
     BidPortfolio<Material>::Ptr tails_port(new BidPortfolio<Material>());
 
+    // offer bids for all tails material, keeping discrete quantities
+    // to preserve possible variation in composition (up to tails_band)
+    CoalesceTails_();
+    MatVec mats = tails.PopN(tails.count());
+    tails.Push(mats);
+
     std::vector<Request<Material>*>& tails_requests =
         out_requests[tails_commod];
     std::vector<Request<Material>*>::iterator it;
     for (it = tails_requests.begin(); it != tails_requests.end(); ++it) {
-      // offer bids for all tails material, keeping discrete quantities
-      // to preserve possible variation in composition
-      MatVec mats = tails.PopN(tails.count());
-      tails.Push(mats);
       for (int k = 0; k < mats.size(); k++) {
         Material::Ptr m = mats[k];
         Request<Material>* req = *it;
@@ -212,6 +352,16 @@ std::set<cyclus::BidPortfolio<Material>::Ptr> Enrichment::GetMatlBids(
     std::vector<Request<Material>*>& commod_requests =
         out_requests[product_commod];
     std::vector<Request<Material>*>::iterator it;
+
+    if (optimize_tails) {
+      OptimizeTails_(commod_requests);
+    }
+
+    // offers for the same requested composition share a composition, so
+    // their costs are only computed once
+    offer_comps_.clear();
+    EnrichmentCosts::Ptr costs(new EnrichmentCosts(FeedAssay(), TailsAssay()));
+
     for (it = commod_requests.begin(); it != commod_requests.end(); ++it) {
       Request<Material>* req = *it;
       Material::Ptr mat = req->target();
@@ -220,12 +370,13 @@ std::set<cyclus::BidPortfolio<Material>::Ptr> Enrichment::GetMatlBids(
           ((request_enrich < max_enrich) ||
            (cyclus::AlmostEq(request_enrich, max_enrich)))) {
         Material::Ptr offer = Offer_(req->target());
+        costs->Add(offer);
         commod_port->AddBid(req, offer, this);
       }
     }
 
-    Converter<Material>::Ptr sc(new SWUConverter(FeedAssay(), tails_assay));
-    Converter<Material>::Ptr nc(new NatUConverter(FeedAssay(), tails_assay));
+    Converter<Material>::Ptr sc(new SWUConverter(costs));
+    Converter<Material>::Ptr nc(new NatUConverter(costs));
     CapacityConstraint<Material> swu(swu_capacity, sc);
     CapacityConstraint<Material> natu(inventory.quantity(), nc);
     commod_port->AddConstraint(swu);
@@ -245,7 +396,45 @@ bool Enrichment::ValidReq(const Material::Ptr mat) {
   cyclus::toolkit::MatQuery q(mat);
   double u235 = q.atom_frac(922350000);
   double u238 = q.atom_frac(922380000);
-  return (u238 > 0 && u235 / (u235 + u238) > tails_assay);
+  return (u238 > 0 && u235 / (u235 + u238) > TailsAssay());
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+void Enrichment::OptimizeTails_(
+    const std::vector<cyclus::Request<Material>*>& requests) {
+  using cyclus::toolkit::UraniumAssayMass;
+
+  // enrich to the quantity weighted product assay of all requests we could
+  // fill at any tails assay in the bounds
+  double qty = 0;
+  double assay_qty = 0;
+  double min_assay = max_tails_assay;
+  for (int i = 0; i < requests.size(); i++) {
+    Material::Ptr m = requests[i]->target();
+    double assay = UraniumAssayMass(m);
+    if (assay > min_tails_assay &&
+        (assay < max_enrich || cyclus::AlmostEq(assay, max_enrich))) {
+      qty += m->quantity();
+      assay_qty += m->quantity() * assay;
+      min_assay = std::min(min_assay, assay);
+    }
+  }
+  if (qty <= 0) {
+    return;
+  }
+
+  // tails must stay below every requested assay, otherwise ValidReq drops
+  // the low enriched requests
+  double hi = std::min(max_tails_assay, min_assay * (1 - 1e-9));
+  AssayTracker& totals = FeedTotals_();
+  double feed_u = totals.u235() + totals.u238();
+  optimal_tails_assay_ = OptimalTailsAssay(
+      totals.assay(), assay_qty / qty, feed_u, current_swu_capacity,
+      min_tails_assay, hi);
+
+  LOG(cyclus::LEV_INFO4, "EnrFac") << prototype()
+                                   << " chose a tails assay of "
+                                   << optimal_tails_assay_;
 }
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
@@ -255,9 +444,6 @@ void Enrichment::GetMatlTrades(
                           Material::Ptr> >& responses) {
   using cyclus::Trade;
 
-  intra_timestep_swu_ = 0;
-  intra_timestep_feed_ = 0;
-
   std::vector<Trade<Material>>::const_iterator it;
   for (it = trades.begin(); it != trades.end(); ++it) {
     double qty = it->amt;
@@ -322,12 +508,14 @@ void Enrichment::AddMat_(Material::Ptr mat) {
   LOG(cyclus::LEV_INFO5, "EnrFac") << prototype() << " is initially holding "
                                    << inventory.quantity() << " total.";
 
+  AssayTracker& totals = FeedTotals_();
   try {
     inventory.Push(mat);
   } catch (cyclus::Error& e) {
     e.msg(Agent::InformErrorMsg(e.msg()));
     throw e;
   }
+  totals.Add(mat);
 
   LOG(cyclus::LEV_INFO5, "EnrFac")
       << prototype() << " added " << mat->quantity() << " of " << feed_commod
@@ -344,12 +532,17 @@ Material::Ptr Enrichment::Request_() {
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 Material::Ptr Enrichment::Offer_(Material::Ptr mat) {
-  cyclus::toolkit::MatQuery q(mat);
-  cyclus::CompMap comp;
-  comp[922350000] = q.atom_frac(922350000);
-  comp[922380000] = q.atom_frac(922380000);
-  return Material::CreateUntracked(
-      mat->quantity(), cyclus::Composition::CreateFromAtom(comp));
+  int id = mat->comp()->id();
+  std::map<int, cyclus::Composition::Ptr>::iterator it = offer_comps_.find(id);
+  if (it == offer_comps_.end()) {
+    cyclus::toolkit::MatQuery q(mat);
+    cyclus::CompMap comp;
+    comp[922350000] = q.atom_frac(922350000);
+    comp[922380000] = q.atom_frac(922380000);
+    it = offer_comps_.insert(std::make_pair(
+        id, cyclus::Composition::CreateFromAtom(comp))).first;
+  }
+  return Material::CreateUntracked(mat->quantity(), it->second);
 }
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 Material::Ptr Enrichment::Enrich_(Material::Ptr mat,
@@ -358,24 +551,16 @@ Material::Ptr Enrichment::Enrich_(Material::Ptr mat,
   using cyclus::toolkit::UraniumAssayMass;
   using cyclus::toolkit::SwuRequired;
   using cyclus::toolkit::FeedQty;
-  using cyclus::toolkit::TailsQty;
 
   // get enrichment parameters
-  Assays assays(FeedAssay(), UraniumAssayMass(mat), tails_assay);
+  Assays assays(FeedAssay(), UraniumAssayMass(mat), TailsAssay());
   double swu_req = SwuRequired(qty, assays);
   double natu_req = FeedQty(qty, assays);
 
   // Determine the composition of the natural uranium
   // (ie. U-235+U-238/TotalMass)
-  double pop_qty = inventory.quantity();
-  Material::Ptr natu_matl = inventory.Pop(pop_qty, cyclus::eps_rsrc());
-  inventory.Push(natu_matl);
-
-  cyclus::toolkit::MatQuery mq(natu_matl);
-  std::set<cyclus::Nuc> nucs;
-  nucs.insert(922350000);
-  nucs.insert(922380000);
-  double natu_frac = mq.mass_frac(nucs);
+  AssayTracker& totals = FeedTotals_();
+  double natu_frac = totals.natu_frac();
   double feed_req = natu_req / natu_frac;
 
   // pop amount from inventory and blob it into one material
@@ -387,8 +572,14 @@ Material::Ptr Enrichment::Enrich_(Material::Ptr mat,
     } else {
       r = inventory.Pop(feed_req, cyclus::eps_rsrc());
     }
+    if (inventory.count() == 0) {
+      // don't leave round-off behind
+      totals.Clear();
+    } else {
+      totals.Remove(r);
+    }
   } catch (cyclus::Error& e) {
-    NatUConverter nc(FeedAssay(), tails_assay);
+    NatUConverter nc(FeedAssay(), TailsAssay());
     std::stringstream ss;
     ss << " tried to remove " << feed_req << " from its inventory of size "
        << inventory.quantity()
@@ -401,14 +592,22 @@ Material::Ptr Enrichment::Enrich_(Material::Ptr mat,
   // blob
   cyclus::Composition::Ptr comp = mat->comp();
   Material::Ptr response = r->ExtractComp(qty, comp);
+  double tails_qty = r->quantity();
   tails.Push(r);
 
   current_swu_capacity -= swu_req;
 
   intra_timestep_swu_ += swu_req;
   intra_timestep_feed_ += feed_req;
-  RecordEnrichment_(feed_req, swu_req);
+  intra_timestep_product_ += qty;
+  intra_timestep_tails_ += tails_qty;
+  if (!aggregate_records || record_trades) {
+    RecordEnrichment_(feed_req, swu_req);
+  }
 
+  if (cyclus::Logger::ReportLevel() < cyclus::LEV_INFO5) {
+    return response;
+  }
   LOG(cyclus::LEV_INFO5, "EnrFac") << prototype()
                                    << " has performed an enrichment: ";
   LOG(cyclus::LEV_INFO5, "EnrFac") << "   * Feed Qty: " << feed_req;
@@ -417,8 +616,7 @@ Material::Ptr Enrichment::Enrich_(Material::Ptr mat,
   LOG(cyclus::LEV_INFO5, "EnrFac") << "   * Product Qty: " << qty;
   LOG(cyclus::LEV_INFO5, "EnrFac") << "   * Product Assay: "
                                    << assays.Product() * 100;
-  LOG(cyclus::LEV_INFO5, "EnrFac") << "   * Tails Qty: "
-                                   << TailsQty(qty, assays);
+  LOG(cyclus::LEV_INFO5, "EnrFac") << "   * Tails Qty: " << tails_qty;
   LOG(cyclus::LEV_INFO5, "EnrFac") << "   * Tails Assay: "
                                    << assays.Tails() * 100;
   LOG(cyclus::LEV_INFO5, "EnrFac") << "   * SWU: " << swu_req;
@@ -428,6 +626,42 @@ Material::Ptr Enrichment::Enrich_(Material::Ptr mat,
   return response;
 }
 
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+void Enrichment::CoalesceTails_() {
+  using cyclus::toolkit::MatQuery;
+  using cyclus::toolkit::MatVec;
+
+  if (tails_band <= 0 || tails.count() < 2) {
+    return;
+  }
+
+  MatVec mats = tails.PopN(tails.count());
+  std::map<int, Material::Ptr> merged;
+  MatVec order;
+  for (int i = 0; i < mats.size(); i++) {
+    MatQuery mq(mats[i]);
+    double u235 = mq.mass(922350000);
+    double u238 = mq.mass(922380000);
+    int band = -1;  // no uranium
+    if (u235 + u238 > 0) {
+      band = static_cast<int>(std::floor(u235 / (u235 + u238) / tails_band));
+    }
+
+    std::map<int, Material::Ptr>::iterator it = merged.find(band);
+    if (it == merged.end()) {
+      merged[band] = mats[i];
+      order.push_back(mats[i]);
+    } else {
+      it->second->Absorb(mats[i]);
+    }
+  }
+  tails.Push(order);
+
+  LOG(cyclus::LEV_DEBUG2, "EnrFac") << prototype() << " merged "
+                                    << mats.size() << " tails materials into "
+                                    << order.size();
+}
+
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 void Enrichment::RecordEnrichment_(double natural_u, double swu) {
   using cyclus::Context;
@@ -446,16 +680,64 @@ void Enrichment::RecordEnrichment_(double natural_u, double swu) {
       ->AddVal("SWU", swu)
       ->Record();
 }
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+void Enrichment::RecordEnrichmentTotals_() {
+  cyclus::Context* ctx = Agent::context();
+  ctx->NewDatum("EnrichmentTotals")
+      ->AddVal("AgentId", id())
+      ->AddVal("Time", ctx->time())
+      ->AddVal("Natural_Uranium", intra_timestep_feed_)
+      ->AddVal("SWU", intra_timestep_swu_)
+      ->AddVal("Product", intra_timestep_product_)
+      ->AddVal("Tails", intra_timestep_tails_)
+      ->Record();
+}
+
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 double Enrichment::FeedAssay() {
   if (inventory.empty()) {
     return 0;
   }
-  double pop_qty = inventory.quantity();
-  Material::Ptr fission_matl =
-      inventory.Pop(pop_qty, cyclus::eps_rsrc());
-  inventory.Push(fission_matl);
-  return cyclus::toolkit::UraniumAssayMass(fission_matl);
+  return FeedTotals_().assay();
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+AssayTracker& Enrichment::FeedTotals_() {
+  if (!feed_totals_synced_) {
+    feed_totals_.Clear();
+    cyclus::toolkit::MatVec mats = inventory.PopN(inventory.count());
+    inventory.Push(mats);
+    for (int i = 0; i < mats.size(); i++) {
+      feed_totals_.Add(mats[i]);
+    }
+    feed_totals_synced_ = true;
+  }
+  return feed_totals_;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+void AssayTracker::Update(Material::Ptr m, double sign) {
+  const cyclus::CompMap& cm = m->comp()->mass();
+  double tot = 0;
+  double u235 = 0;
+  double u238 = 0;
+  cyclus::CompMap::const_iterator it;
+  for (it = cm.begin(); it != cm.end(); ++it) {
+    tot += it->second;
+    if (it->first == 922350000) {
+      u235 += it->second;
+    } else if (it->first == 922380000) {
+      u238 += it->second;
+    }
+  }
+  if (tot <= 0) {
+    return;
+  }
+
+  double scale = sign * m->quantity() / tot;
+  u235_ += u235 * scale;
+  u238_ += u238 * scale;
+  mass_ += m->quantity() * sign;
 }
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
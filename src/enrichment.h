@@ -1,6 +1,7 @@
 #ifndef CYCAMORE_SRC_ENRICHMENT_H_
 #define CYCAMORE_SRC_ENRICHMENT_H_
 
+#include <map>
 #include <string>
 
 #include "cyclus.h"
@@ -10,14 +11,64 @@
 
 namespace cycamore {
 
+/// @class EnrichmentCosts
+///
+/// @brief The EnrichmentCosts holds the SWU and natural uranium needed per kg
+/// of product for the materials an Enrichment facility bids on.  The value
+/// function of the feed and tails assays is evaluated once on construction
+/// and the per kg costs are stored per composition, so constraining an arc
+/// only takes a lookup and a multiplication by the arc quantity.  Costs are
+/// added while bidding and the SWU and natural uranium converters share them.
+class EnrichmentCosts {
+ public:
+  typedef boost::shared_ptr<EnrichmentCosts> Ptr;
+
+  EnrichmentCosts(double feed, double tails);
+
+  /// Computes and stores the per kg costs for the composition of m.
+  void Add(cyclus::Material::Ptr m);
+
+  /// @return the SWU required to produce m, computing the per kg costs if the
+  /// composition of m was not added
+  double Swu(cyclus::Material::Ptr m) const {
+    return m->quantity() * Get(m).swu;
+  }
+
+  /// @return the natural uranium required to produce m, computing the per kg
+  /// costs if the composition of m was not added
+  double NatU(cyclus::Material::Ptr m) const {
+    return m->quantity() * Get(m).natu;
+  }
+
+  double feed() const { return feed_; }
+  double tails() const { return tails_; }
+  int size() const { return costs_.size(); }
+
+ private:
+  struct Costs {
+    double swu;
+    double natu;
+  };
+
+  Costs Get(cyclus::Material::Ptr m) const;
+  Costs Compute(cyclus::Material::Ptr m) const;
+
+  double feed_, tails_;
+  double v_feed_, v_tails_;
+
+  // keyed by composition id
+  std::map<int, Costs> costs_;
+};
+
 /// @class SWUConverter
 ///
 /// @brief The SWUConverter is a simple Converter class for material to
 /// determine the amount of SWU required for their proposed enrichment
 class SWUConverter : public cyclus::Converter<cyclus::Material> {
  public:
-  SWUConverter(double feed_commod, double tails) : feed_(feed_commod),
-    tails_(tails) {}
+  SWUConverter(double feed_commod, double tails)
+      : costs_(new EnrichmentCosts(feed_commod, tails)) {}
+  SWUConverter(EnrichmentCosts::Ptr costs) : costs_(costs) {}
   virtual ~SWUConverter() {}
 
   /// @brief provides a conversion for the SWU required
@@ -26,21 +77,19 @@ class SWUConverter : public cyclus::Converter<cyclus::Material> {
       cyclus::Arc const * a = NULL,
       cyclus::ExchangeTranslationContext<cyclus::Material>
           const * ctx = NULL) const {
-    cyclus::toolkit::Assays assays(feed_, cyclus::toolkit::UraniumAssayMass(m),
-                                   tails_);
-    return cyclus::toolkit::SwuRequired(m->quantity(), assays);
+    return costs_->Swu(m);
   }
 
   /// @returns true if Converter is a SWUConverter and feed and tails equal
   virtual bool operator==(Converter& other) const {
     SWUConverter* cast = dynamic_cast<SWUConverter*>(&other);
     return cast != NULL &&
-    feed_ == cast->feed_ &&
-    tails_ == cast->tails_;
+    costs_->feed() == cast->costs_->feed() &&
+    costs_->tails() == cast->costs_->tails();
   }
 
  private:
-  double feed_, tails_;
+  EnrichmentCosts::Ptr costs_;
 };
 
 /// @class NatUConverter
@@ -50,8 +99,9 @@ class SWUConverter : public cyclus::Converter<cyclus::Material> {
 /// enrichment
 class NatUConverter : public cyclus::Converter<cyclus::Material> {
  public:
-  NatUConverter(double feed_commod, double tails) : feed_(feed_commod),
-    tails_(tails) {}
+  NatUConverter(double feed_commod, double tails)
+      : costs_(new EnrichmentCosts(feed_commod, tails)) {}
+  NatUConverter(EnrichmentCosts::Ptr costs) : costs_(costs) {}
   virtual ~NatUConverter() {}
 
   virtual std::string version() { return CYCAMORE_VERSION; }
@@ -62,30 +112,72 @@ class NatUConverter : public cyclus::Converter<cyclus::Material> {
       cyclus::Arc const * a = NULL,
       cyclus::ExchangeTranslationContext<cyclus::Material>
           const * ctx = NULL) const {
-    cyclus::toolkit::Assays assays(feed_, cyclus::toolkit::UraniumAssayMass(m),
-                                   tails_);
-    cyclus::toolkit::MatQuery mq(m);
-    std::set<cyclus::Nuc> nucs;
-    nucs.insert(922350000);
-    nucs.insert(922380000);
-
-    double natu_frac = mq.mass_frac(nucs);
-    double natu_req = cyclus::toolkit::FeedQty(m->quantity(), assays);
-    return natu_req / natu_frac;
+    return costs_->NatU(m);
   }
 
   /// @returns true if Converter is a NatUConverter and feed and tails equal
   virtual bool operator==(Converter& other) const {
     NatUConverter* cast = dynamic_cast<NatUConverter*>(&other);
     return cast != NULL &&
-    feed_ == cast->feed_ &&
-    tails_ == cast->tails_;
+    costs_->feed() == cast->costs_->feed() &&
+    costs_->tails() == cast->costs_->tails();
   }
 
  private:
-  double feed_, tails_;
+  EnrichmentCosts::Ptr costs_;
+};
+
+/// @class AssayTracker
+///
+/// @brief The AssayTracker keeps running U-235, U-238 and total mass sums of
+/// the materials held in an inventory so that the assay and natural uranium
+/// fraction of the inventory as a whole can be read without squashing it.
+class AssayTracker {
+ public:
+  AssayTracker() : u235_(0), u238_(0), mass_(0) {}
+
+  /// @brief adds the uranium content of m to the totals
+  void Add(cyclus::Material::Ptr m) { Update(m, 1); }
+
+  /// @brief removes the uranium content of m from the totals
+  void Remove(cyclus::Material::Ptr m) { Update(m, -1); }
+
+  void Clear() {
+    u235_ = 0;
+    u238_ = 0;
+    mass_ = 0;
+  }
+
+  /// @return the U-235 mass fraction of the U-235 and U-238 held, as for
+  /// cyclus::toolkit::UraniumAssayMass
+  double assay() const {
+    return u235_ + u238_ > 0 ? u235_ / (u235_ + u238_) : 0;
+  }
+
+  /// @return the mass fraction of U-235 and U-238 in all material held
+  double natu_frac() const { return mass_ > 0 ? (u235_ + u238_) / mass_ : 0; }
+
+  double u235() const { return u235_; }
+  double u238() const { return u238_; }
+  double mass() const { return mass_; }
+
+ private:
+  void Update(cyclus::Material::Ptr m, double sign);
+
+  double u235_;
+  double u238_;
+  double mass_;
 };
 
+/// Returns the tails assay in [lo, hi] that maximizes the product of the
+/// given assay that can be made from feed_qty of uranium feed with the given
+/// SWU.  Lower tails assays use less feed but more SWU per kg of product, so
+/// the result is the tails assay at which feed and SWU run out together, or
+/// the bound closest to it.  hi is limited to below the feed and product
+/// assays.
+double OptimalTailsAssay(double feed_assay, double product_assay,
+                         double feed_qty, double swu, double lo, double hi);
+
 ///  The Enrichment facility is a simple Agent that enriches natural
 ///  uranium in a Cyclus simulation. It does not explicitly compute
 ///  the physical enrichment process, rather it calculates the SWU
@@ -99,7 +191,8 @@ class NatUConverter : public cyclus::Converter<cyclus::Material> {
 ///  trading the same input commodity (even with different recipes) will
 ///  offer materials for trade.  The Enrichment facility accepts any input
 ///  materials with enrichments less than its tails assay, as long as some
-///  U235 is present, and preference increases with U235 content.  If no
+///  U235 is present, and preference increases with U235 content (either by
+///  rank or by assay bucket, see pref_assay_bucket).  If no
 ///  U235 is present in the offered material, the trade preference is set
 ///  to -1 and the material is not accepted.  Any material components other
 ///  other than U235 and U238 are sent directly to the tails buffer.
@@ -115,9 +208,16 @@ class NatUConverter : public cyclus::Converter<cyclus::Material> {
 ///  commodity without an associated requested enriched recipe will not be
 ///  fulfilled.
 ///
+///  If optimize_tails is set, the tails assay is chosen every time step
+///  between min_tails_assay and max_tails_assay to make the most product
+///  from the current SWU capacity and feed inventory (see OptimalTailsAssay),
+///  using the quantity weighted assay of the product requests.
+///
 ///  The Enrichment facility also offers its tails as an output commodity with
 ///  no associated recipe.  Bids for tails are constrained only by total
-///  tails inventory.
+///  tails inventory.  If a tails band is given, tails whose U235 assays fall
+///  in the same band are merged before bidding so that the number of tails
+///  bids per request stays bounded over long simulations.
 
 class Enrichment
   : public cyclus::Facility,
@@ -155,7 +255,9 @@ class Enrichment
   "fulfilled."				\
   "\n\n"								\
   "Accumulated tails inventory is offered for trading as a specifiable " \
-  "output commodity.", \
+  "output commodity.  If a tails band is given, tails whose U235 assays " \
+  "fall in the same band are merged before bidding so that the number of " \
+  "tails bids per request stays bounded over long simulations.", \
 }
  public:
   // --- Module Members ---
@@ -246,6 +348,17 @@ class Enrichment
 
   inline double SwuCapacity() const { return swu_capacity; }
 
+  inline void TailsBand(double band) { tails_band = band; }
+
+  inline double TailsBand() const { return tails_band; }
+
+  inline void PrefAssayBucket(double bucket) { pref_assay_bucket = bucket; }
+
+  /// @brief the tails assay used for enrichments in the current time step
+  inline double TailsAssay() const {
+    return optimal_tails_assay_ > 0 ? optimal_tails_assay_ : tails_assay;
+  }
+
   inline const cyclus::toolkit::ResBuf<cyclus::Material>& Tails() const {
     return tails;
   }
@@ -265,19 +378,39 @@ class Enrichment
   ///  @brief Generates a material offer for a given request. The response
   ///  composition will be comprised only of U235 and U238 at their relative
   ///  ratio in the requested material. The response quantity will be the
-  ///  same as the requested commodity.
+  ///  same as the requested commodity. Offers for requests of the same
+  ///  composition share a single composition while bidding.
   ///
   ///  @param req the requested material being responded to
   cyclus::Material::Ptr Offer_(cyclus::Material::Ptr req);
 
   cyclus::Material::Ptr Enrich_(cyclus::Material::Ptr mat, double qty);
 
+  ///  @brief chooses the tails assay for this time step from the product
+  ///  requests, feed inventory and SWU capacity
+  void OptimizeTails_(
+      const std::vector<cyclus::Request<cyclus::Material>*>& requests);
+
   ///  @brief calculates the feed assay based on the unenriched inventory
   double FeedAssay();
 
+  ///  @brief returns the running uranium totals of the natural uranium
+  ///  inventory, building them from the inventory on first use (e.g. after
+  ///  initial feed is added or the facility is restored from a snapshot)
+  AssayTracker& FeedTotals_();
+
+  ///  @brief merges tails materials whose U235 assays fall within the same
+  ///  tails_band wide band, keeping the bands in order of first appearance.
+  ///  Does nothing if tails_band is not positive.
+  void CoalesceTails_();
+
   ///  @brief records and enrichment with the cyclus::Recorder
   void RecordEnrichment_(double natural_u, double swu);
 
+  ///  @brief records the natural uranium, SWU, product and tails of all
+  ///  enrichments performed this time step with the cyclus::Recorder
+  void RecordEnrichmentTotals_();
+
   #pragma cyclus var { \
     "tooltip": "feed commodity",					\
     "doc": "feed commodity that the enrichment facility accepts",	\
@@ -365,6 +498,83 @@ class Enrichment
   }
   bool order_prefs;
 
+  #pragma cyclus var { \
+    "default": 0,		       \
+    "userlevel": 10,							\
+    "tooltip": "U235 assay bucket width for feed preferences",		\
+    "uilabel": "Feed Preference Assay Bucket", \
+    "uitype": "range", \
+    "range": [0.0, 1.0], \
+    "doc": "when preference ordering is on, give feed offers the index of " \
+           "their U235 assay bucket of this width as preference instead of " \
+           "their rank among all offers, so offers of similar assay share " \
+           "a preference. A value of zero ranks every offer." \
+  }
+  double pref_assay_bucket;
+
+  #pragma cyclus var { \
+    "default": False, \
+    "userlevel": 10, \
+    "tooltip": "Whether to record enrichments once per time step", \
+    "doc": "If true, the natural uranium, SWU, product and tails of all " \
+           "enrichments performed in a time step are recorded as a single " \
+           "row in the EnrichmentTotals table instead of one row per trade " \
+           "in the Enrichments table.", \
+    "uilabel": "Aggregate Enrichment Records", \
+    "uitype": "bool"}
+  bool aggregate_records;
+
+  #pragma cyclus var { \
+    "default": False, \
+    "userlevel": 10, \
+    "tooltip": "Whether to also record every trade in Enrichments", \
+    "doc": "If true and aggregate_records is true, one row per trade is " \
+           "still recorded in the Enrichments table, e.g. for debugging.", \
+    "uilabel": "Record Every Enrichment", \
+    "uitype": "bool"}
+  bool record_trades;
+
+  #pragma cyclus var { \
+    "default": False, \
+    "userlevel": 10, \
+    "tooltip": "Whether to choose the tails assay every time step", \
+    "doc": "If true, the tails assay is chosen every time step between " \
+           "min_tails_assay and max_tails_assay to make the most product " \
+           "from the SWU capacity and feed inventory, and tails_assay is " \
+           "only used on time steps without product requests. The chosen " \
+           "tails assay never exceeds the lowest requested product assay " \
+           "and is recorded in the TimeSeriesTailsAssay table.", \
+    "uilabel": "Optimize Tails Assay", \
+    "uitype": "bool"}
+  bool optimize_tails;
+
+  #pragma cyclus var { \
+    "default": 0.001, \
+    "userlevel": 10, \
+    "tooltip": "lowest tails assay when optimizing", \
+    "doc": "lowest tails assay that may be chosen when optimize_tails is set", \
+    "uilabel": "Minimum Tails Assay", \
+    "uitype": "range", \
+    "range": [0.0, 1.0]}
+  double min_tails_assay;
+
+  #pragma cyclus var { \
+    "default": 0.003, \
+    "userlevel": 10, \
+    "tooltip": "highest tails assay when optimizing", \
+    "doc": "highest tails assay that may be chosen when optimize_tails is " \
+           "set", \
+    "uilabel": "Maximum Tails Assay", \
+    "uitype": "range", \
+    "range": [0.0, 1.0]}
+  double max_tails_assay;
+
+  #pragma cyclus var {"default": 0, "internal": True, \
+                      "doc": "Tails assay chosen for the current time step " \
+                             "when optimize_tails is set, zero if none has " \
+                             "been chosen this time step."}
+  double optimal_tails_assay_;
+
   #pragma cyclus var {						       \
     "default": CY_LARGE_DOUBLE,						       \
     "tooltip": "SWU capacity (kgSWU/timestep)",			       \
@@ -376,6 +586,21 @@ class Enrichment
   }
   double swu_capacity;
 
+  #pragma cyclus var { \
+    "default": 0,						\
+    "userlevel": 10,							\
+    "tooltip": "tails assay band width for merging tails",		\
+    "uilabel": "Tails Consolidation Band", \
+    "uitype": "range", \
+    "range": [0.0, 1.0], \
+    "doc": "width of the U235 assay bands used to merge tails before they " \
+           "are offered for trade. Tails whose assays fall in the same band " \
+           "are combined into a single material, so each tails request " \
+           "receives one bid per band rather than one bid per enrichment. " \
+           "A value of zero keeps every tails material separate." \
+  }
+  double tails_band;
+
   double current_swu_capacity;
 
   #pragma cyclus var { 'capacity': 'max_feed_inventory' }
@@ -383,10 +608,23 @@ class Enrichment
   #pragma cyclus var {}
   cyclus::toolkit::ResBuf<cyclus::Material> tails;  // depleted u
 
-  // used to total intra-timestep swu and natu usage for meeting requests -
-  // these help enable time series generation.
+  // used to total intra-timestep swu, natu, product and tails for meeting
+  // requests - these help enable time series generation and aggregated
+  // records.
   double intra_timestep_swu_;
   double intra_timestep_feed_;
+  double intra_timestep_product_;
+  double intra_timestep_tails_;
+
+
+  // offer compositions keyed by requested composition id - rebuilt every
+  // time the facility bids
+  std::map<int, cyclus::Composition::Ptr> offer_comps_;
+
+  // running uranium totals of inventory - derived from its contents, so not
+  // a state var
+  AssayTracker feed_totals_;
+  bool feed_totals_synced_;
 
   friend class EnrichmentTest;
   // ---
@@ -1,5 +1,6 @@
 #include <gtest/gtest.h>
 
+#include <algorithm>
 #include <sstream>
 
 #include "facility_tests.h"
@@ -314,6 +315,66 @@ TEST_F(EnrichmentTest, TradeTails) {
     "Not providing the requested quantity" ;
 }
 
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+TEST_F(EnrichmentTest, AggregateRecords) {
+  // this tests that enrichments are recorded once per time step in
+  // aggregated mode, with per-trade rows kept only on request
+
+  std::string config =
+    "   <feed_commod>natu</feed_commod> "
+    "   <feed_recipe>natu1</feed_recipe> "
+    "   <product_commod>enr_u</product_commod> "
+    "   <tails_commod>tails</tails_commod> "
+    "   <tails_assay>0.003</tails_assay> "
+    "   <aggregate_records>1</aggregate_records> "
+    "   <record_trades>1</record_trades> ";
+
+  int simdur = 4;
+  cyclus::MockSim sim(cyclus::AgentSpec
+          (":cycamore:Enrichment"), config, simdur);
+  sim.AddRecipe("natu1", c_natu1());
+  sim.AddRecipe("leu", c_leu());
+
+  sim.AddSource("natu")
+    .recipe("natu1")
+    .Finalize();
+  for (int i = 0; i < 3; i++) {
+    sim.AddSink("enr_u")
+      .recipe("leu")
+      .capacity(0.5)
+      .Finalize();
+  }
+
+  int id = sim.Run();
+
+  QueryResult qr = sim.db().Query("EnrichmentTotals", NULL);
+  EXPECT_EQ(simdur, qr.rows.size());
+
+  std::vector<Cond> conds;
+  conds.push_back(Cond("Commodity", "==", std::string("enr_u")));
+  QueryResult xacts = sim.db().Query("Transactions", &conds);
+  QueryResult trades = sim.db().Query("Enrichments", NULL);
+  ASSERT_GT(xacts.rows.size(), 0);
+  EXPECT_EQ(xacts.rows.size(), trades.rows.size());
+
+  double product = 0;
+  double natu = 0;
+  double swu = 0;
+  for (int i = 0; i < qr.rows.size(); i++) {
+    product += qr.GetVal<double>("Product", i);
+    natu += qr.GetVal<double>("Natural_Uranium", i);
+    swu += qr.GetVal<double>("SWU", i);
+    EXPECT_GE(qr.GetVal<double>("Tails", i), 0);
+  }
+  for (int i = 0; i < trades.rows.size(); i++) {
+    natu -= trades.GetVal<double>("Natural_Uranium", i);
+    swu -= trades.GetVal<double>("SWU", i);
+  }
+  EXPECT_NEAR(0.5 * xacts.rows.size(), product, 1e-9);
+  EXPECT_NEAR(0, natu, 1e-9);
+  EXPECT_NEAR(0, swu, 1e-9);
+}
+
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 TEST_F(EnrichmentTest, BidPrefs) {
   // This tests that natu sources are preference-ordered by
@@ -405,6 +466,43 @@ TEST_F(EnrichmentTest, BidPrefs) {
   EXPECT_EQ(2, qr.rows.size());
   }
 
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+TEST_F(EnrichmentTest, AssayBucketPrefs) {
+  // Tests that feed offers are ranked by U235 content by default and share a
+  // preference per assay bucket when pref_assay_bucket is set
+  using cyclus::Bid;
+  using cyclus::Composition;
+  using cyclus::Request;
+
+  double u235[] = {0.0072, 0, 0.0055, 0.0071};
+  Request<Material>* req =
+      Request<Material>::Create(GetMat(4), src_facility, feed_commod);
+  std::vector<Bid<Material>*> bids;
+  cyclus::PrefMap<Material>::type prefs;
+  for (int i = 0; i < 4; i++) {
+    CompMap v;
+    v[922350000] = u235[i];
+    v[922380000] = 1 - u235[i];
+    Material::Ptr offer =
+        Material::CreateUntracked(1, Composition::CreateFromMass(v));
+    bids.push_back(Bid<Material>::Create(req, offer, trader));
+    prefs[req][bids[i]] = 1;
+  }
+
+  src_facility->AdjustMatlPrefs(prefs);
+  EXPECT_EQ(4, prefs[req][bids[0]]);
+  EXPECT_EQ(-1, prefs[req][bids[1]]);
+  EXPECT_EQ(2, prefs[req][bids[2]]);
+  EXPECT_EQ(3, prefs[req][bids[3]]);
+
+  src_facility->PrefAssayBucket(0.001);
+  src_facility->AdjustMatlPrefs(prefs);
+  EXPECT_EQ(8, prefs[req][bids[0]]);
+  EXPECT_EQ(-1, prefs[req][bids[1]]);
+  EXPECT_EQ(6, prefs[req][bids[2]]);
+  EXPECT_EQ(8, prefs[req][bids[3]]);
+}
+
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 TEST_F(EnrichmentTest, ZeroU235) {
   // Test that offers of natu with no u235 content are rejected
@@ -470,6 +568,7 @@ void EnrichmentTest::InitParameters() {
   ctx->AddRecipe(feed_recipe, recipe);
 
   tails_assay = 0.002;
+  max_enrich = 1.0;
   swu_capacity = 100; //**
   inv_size = 5;
 
@@ -495,6 +594,15 @@ Material::Ptr EnrichmentTest::GetMat(double qty) {
                                            tc_.get()->GetRecipe(feed_recipe));
 }
 
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+Material::Ptr EnrichmentTest::GetReqMat(double qty, double enr) {
+  CompMap v;
+  v[922350000] = enr;
+  v[922380000] = 1 - enr;
+  return Material::CreateUntracked(
+      qty, cyclus::Composition::CreateFromMass(v));
+}
+
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 void EnrichmentTest::DoAddMat(Material::Ptr mat) {
   src_facility->AddMat_(mat);
@@ -517,6 +625,17 @@ EnrichmentTest::DoEnrich(Material::Ptr mat, double qty) {
   return src_facility->Enrich_(mat, qty);
 }
 
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+void EnrichmentTest::DoCoalesceTails() {
+  src_facility->CoalesceTails_();
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+void EnrichmentTest::DoOptimizeTails(
+    const std::vector<cyclus::Request<Material>*>& reqs) {
+  src_facility->OptimizeTails_(reqs);
+}
+
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 TEST_F(EnrichmentTest, Request) {
   // Tests that quantity in material request is accurate
@@ -602,6 +721,103 @@ TEST_F(EnrichmentTest, ValidReq) {
   EXPECT_NEAR(natuc.convert(target) * mass_frac, natuc.convert(offer), 0.001);
 }
 
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+TEST_F(EnrichmentTest, EnrichmentCosts) {
+  // Tests that the memoized per kg costs match the toolkit enrichment
+  // calculations and that offers for the same composition share costs.
+  using cyclus::toolkit::Assays;
+  using cyclus::toolkit::FeedQty;
+  using cyclus::toolkit::SwuRequired;
+
+  EnrichmentCosts::Ptr costs(new EnrichmentCosts(feed_assay, tails_assay));
+  SWUConverter swuc(costs);
+  NatUConverter natuc(costs);
+
+  double enr[] = {0.01, 0.045, 0.2, 0.9};
+  for (int i = 0; i < 4; i++) {
+    Material::Ptr target = GetReqMat(3, enr[i]);
+    Material::Ptr offer = DoOffer(target);
+    costs->Add(offer);
+    costs->Add(DoOffer(Material::CreateUntracked(7, target->comp())));
+    EXPECT_EQ(i + 1, costs->size());
+
+    Assays assays(feed_assay, enr[i], tails_assay);
+    EXPECT_NEAR(SwuRequired(3, assays), swuc.convert(offer), 1e-9);
+    EXPECT_NEAR(FeedQty(3, assays), natuc.convert(offer), 1e-9);
+  }
+
+  // not added
+  Material::Ptr m = GetReqMat(2, 0.05);
+  Assays assays(feed_assay, 0.05, tails_assay);
+  EXPECT_NEAR(SwuRequired(2, assays), swuc.convert(m), 1e-9);
+  EXPECT_EQ(4, costs->size());
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+TEST_F(EnrichmentTest, OptimalTailsAssay) {
+  // Tests that the chosen tails assay balances feed and SWU use, and falls
+  // back to a bound when one of them always limits production.
+  using cyclus::toolkit::Assays;
+  using cyclus::toolkit::FeedQty;
+  using cyclus::toolkit::SwuRequired;
+
+  double xf = 0.0072;
+  double xp = 0.045;
+  double feed = 100;
+  Assays ref(xf, xp, 0.0025);
+  double swu = feed * SwuRequired(1, ref) / FeedQty(1, ref);
+
+  double xt = OptimalTailsAssay(xf, xp, feed, swu, 0.001, 0.004);
+  EXPECT_NEAR(0.0025, xt, 1e-9);
+
+  // making the most product
+  double best = 0;
+  double step = 1e-4;
+  for (int i = -1; i <= 1; i++) {
+    Assays a(xf, xp, xt + i * step);
+    double product = std::min(feed / FeedQty(1, a), swu / SwuRequired(1, a));
+    if (i == 0) {
+      best = product;
+    } else {
+      EXPECT_LT(product, best);
+    }
+  }
+
+  EXPECT_DOUBLE_EQ(0.001, OptimalTailsAssay(xf, xp, feed, 1e299, 0.001,
+                                            0.004));
+  EXPECT_DOUBLE_EQ(0.004, OptimalTailsAssay(xf, xp, feed, 1e-3, 0.001,
+                                            0.004));
+  // never at or above the feed assay
+  EXPECT_LT(OptimalTailsAssay(xf, xp, feed, 1e-3, 0.001, 0.01), xf);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+TEST_F(EnrichmentTest, OptimizeTailsLowRequest) {
+  // Tests that an optimized tails assay stays below the lowest requested
+  // assay even when SWU limits production, and that it is only used for the
+  // time step it was chosen on.
+  using cyclus::Request;
+
+  DoAddMat(GetMat(inv_size));
+  src_facility->SwuCapacity(1e-3);
+
+  Material::Ptr low = GetReqMat(1, 0.0025);
+  std::vector<Request<Material>*> reqs;
+  reqs.push_back(Request<Material>::Create(low, trader, product_commod));
+  reqs.push_back(Request<Material>::Create(GetReqMat(1, 0.05), trader,
+                                           product_commod));
+  DoOptimizeTails(reqs);
+  EXPECT_LT(src_facility->TailsAssay(), 0.0025);
+  EXPECT_LT(0.001, src_facility->TailsAssay());
+
+  src_facility->Tick();
+  EXPECT_DOUBLE_EQ(tails_assay, src_facility->TailsAssay());
+
+  for (int i = 0; i < reqs.size(); i++) {
+    delete reqs[i];
+  }
+}
+
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 TEST_F(EnrichmentTest, Enrich) {
   // this test asks the facility to enrich a material that results in an amount
@@ -649,6 +865,73 @@ TEST_F(EnrichmentTest, Enrich) {
   EXPECT_THROW(response = DoEnrich(target, qty), cyclus::Error);
 }
 
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+TEST_F(EnrichmentTest, FeedAssayTracking) {
+  // Tests that the feed assay follows the combined inventory as materials of
+  // different composition are added and enriched away without the inventory
+  // being squashed.
+  using cyclus::Composition;
+  using cyclus::toolkit::Assays;
+  using cyclus::toolkit::FeedQty;
+
+  src_facility->SetMaxInventorySize(100);
+  EXPECT_EQ(0, src_facility->FeedAssay());
+
+  CompMap v;
+  v[922350000] = 0.01;
+  v[922380000] = 0.98;
+  v[80160000] = 0.01;
+  DoAddMat(GetMat(20));
+  DoAddMat(Material::CreateUntracked(10, Composition::CreateFromMass(v)));
+
+  double u235 = 20 * feed_assay + 0.1;
+  double u238 = 20 * (1 - feed_assay) + 9.8;
+  double assay = u235 / (u235 + u238);
+  EXPECT_NEAR(assay, src_facility->FeedAssay(), 1e-12);
+
+  CompMap p;
+  p[922350000] = 0.05;
+  p[922380000] = 0.95;
+  Material::Ptr target =
+      Material::CreateUntracked(1, Composition::CreateFromMass(p));
+  Assays assays(assay, 0.05, tails_assay);
+  double feed_req = FeedQty(1, assays) / ((u235 + u238) / 30);
+  DoEnrich(target, 1);
+
+  // feed is taken from the first (recipe) material
+  u235 -= feed_req * feed_assay;
+  u238 -= feed_req * (1 - feed_assay);
+  EXPECT_NEAR(u235 / (u235 + u238), src_facility->FeedAssay(), 1e-9);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+TEST_F(EnrichmentTest, CoalesceTails) {
+  // Tests that tails from separate enrichments are kept apart by default and
+  // merged into a single material when they share a tails band, without
+  // changing the total tails quantity.
+  using cyclus::toolkit::Assays;
+
+  src_facility->SetMaxInventorySize(1000);
+  DoAddMat(GetMat(1000));
+  Material::Ptr target = GetReqMat(1, 0.05);
+  for (int i = 0; i < 4; i++) {
+    DoEnrich(target, 1);
+  }
+  ASSERT_EQ(4, src_facility->Tails().count());
+
+  DoCoalesceTails();
+  EXPECT_EQ(4, src_facility->Tails().count());
+
+  double qty = src_facility->Tails().quantity();
+  EXPECT_NEAR(4 * TailsQty(1, Assays(feed_assay, 0.05, tails_assay)), qty,
+              1e-6);
+
+  src_facility->TailsBand(0.01);
+  DoCoalesceTails();
+  EXPECT_EQ(1, src_facility->Tails().count());
+  EXPECT_NEAR(qty, src_facility->Tails().quantity(), 1e-9);
+}
+
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 TEST_F(EnrichmentTest, Response) {
   // this test asks the facility to respond to multiple requests for enriched
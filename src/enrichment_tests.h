@@ -41,6 +41,9 @@ class EnrichmentTest : public ::testing::Test {
   cyclus::Material::Ptr DoBid(cyclus::Material::Ptr mat);
   cyclus::Material::Ptr DoOffer(cyclus::Material::Ptr mat);
   cyclus::Material::Ptr DoEnrich(cyclus::Material::Ptr mat, double qty);
+  void DoCoalesceTails();
+  void DoOptimizeTails(
+      const std::vector<cyclus::Request<cyclus::Material>*>& reqs);
   /// @param nreqs the total number of requests
   /// @param nvalid the number of requests that are valid
   boost::shared_ptr< cyclus::ExchangeContext<cyclus::Material> >
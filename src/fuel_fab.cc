@@ -1,5 +1,7 @@
 #include "fuel_fab.h"
 
+#include <algorithm>
+#include <deque>
 #include <sstream>
 
 using cyclus::Material;
@@ -12,123 +14,103 @@ using pyne::simple_xs;
 
 namespace cycamore {
 
-class FissConverter : public cyclus::Converter<Material> {
- public:
-  FissConverter(Composition::Ptr c_fill, Composition::Ptr c_fiss,
-                Composition::Ptr c_topup, std::string spectrum)
-      : c_fiss_(c_fiss), c_topup_(c_topup), c_fill_(c_fill), spec_(spectrum) {
-    w_fiss_ = CosiWeight(c_fiss, spectrum);
-    w_fill_ = CosiWeight(c_fill, spectrum);
-    w_topup_ = CosiWeight(c_topup, spectrum);
-  }
-
-  virtual ~FissConverter() {}
-
-  virtual double convert(
-      Material::Ptr m, cyclus::Arc const* a = NULL,
-      cyclus::ExchangeTranslationContext<Material> const* ctx =
-          NULL) const {
-    double w_tgt = CosiWeight(m->comp(), spec_);
-    if (ValidWeights(w_fill_, w_tgt, w_fiss_)) {
-      double frac = HighFrac(w_fill_, w_tgt, w_fiss_);
-      return AtomToMassFrac(frac, c_fiss_, c_fill_) * m->quantity();
-    } else if (ValidWeights(w_fiss_, w_tgt, w_topup_)) {
-      // use fiss inventory as filler, and topup as fissile
-      double frac = LowFrac(w_fiss_, w_tgt, w_topup_);
-      return AtomToMassFrac(frac, c_fiss_, c_topup_) * m->quantity();
-    } else {
-      // don't bid at all
-      return cyclus::CY_LARGE_DOUBLE;
-    }
+int StreamBlender::AddStream(Composition::Ptr c, double w, double cost) {
+  int i = weights_.size();
+  if (i > 0 && cost != costs_[0]) {
+    uniform_cost_ = false;
   }
+  comps_.push_back(c);
+  weights_.push_back(w);
+  costs_.push_back(cost);
+  std::vector<int>::iterator it = by_weight_.begin();
+  while (it != by_weight_.end() && weights_[*it] <= w) {
+    ++it;
+  }
+  by_weight_.insert(it, i);
+  return i;
+}
 
- private:
-  std::string spec_;
-  double w_fiss_;
-  double w_topup_;
-  double w_fill_;
-  Composition::Ptr c_fiss_;
-  Composition::Ptr c_fill_;
-  Composition::Ptr c_topup_;
-};
+bool StreamBlender::Solve(double w_tgt, std::vector<double>* fracs) const {
+  fracs->assign(size(), 0);
+  bool found = false;
+  double best = 0;
+
+  // a stream of the target weight meets it on its own.  The tolerance covers
+  // blends whose other stream fraction was rounded to zero while bidding.
+  const double w_eps = 1e-6;
+  int n_lo = 0;
+  for (int k = 0; k < size(); k++) {
+    int i = by_weight_[k];
+    if (weights_[i] < w_tgt) {
+      n_lo = k + 1;
+    }
+    if (std::abs(weights_[i] - w_tgt) > w_eps ||
+        (found && costs_[i] >= best)) {
+      continue;
+    }
+    fracs->assign(size(), 0);
+    (*fracs)[i] = 1;
+    best = costs_[i];
+    found = true;
+  }
+  if (found && uniform_cost_) {
+    return true;
+  }
 
-class FillConverter : public cyclus::Converter<Material> {
- public:
-  FillConverter(Composition::Ptr c_fill, Composition::Ptr c_fiss,
-                Composition::Ptr c_topup, std::string spectrum)
-      : c_fiss_(c_fiss), c_topup_(c_topup), c_fill_(c_fill), spec_(spectrum) {
-    w_fiss_ = CosiWeight(c_fiss, spectrum);
-    w_fill_ = CosiWeight(c_fill, spectrum);
-    w_topup_ = CosiWeight(c_topup, spectrum);
-  }
-
-  virtual ~FillConverter() {}
-
-  virtual double convert(
-      Material::Ptr m, cyclus::Arc const* a = NULL,
-      cyclus::ExchangeTranslationContext<Material> const* ctx =
-          NULL) const {
-    double w_tgt = CosiWeight(m->comp(), spec_);
-    if (ValidWeights(w_fill_, w_tgt, w_fiss_)) {
-      double frac = LowFrac(w_fill_, w_tgt, w_fiss_);
-      return AtomToMassFrac(frac, c_fill_, c_fiss_) * m->quantity();
-    } else if (ValidWeights(w_fiss_, w_tgt, w_topup_)) {
-      // switched fissile inventory to filler so don't need any filler inventory
-      return 0;
-    } else {
-      // don't bid at all
-      return cyclus::CY_LARGE_DOUBLE;
+  // otherwise blend a stream below the target with one above it.  Pairs are
+  // tried nearest the target first so that, at equal cost, the streams of
+  // nearest weight are used.
+  for (int a = n_lo - 1; a >= 0; a--) {
+    for (int b = n_lo; b < size(); b++) {
+      int lo = by_weight_[a];
+      int hi = by_weight_[b];
+      if (!ValidWeights(weights_[lo], w_tgt, weights_[hi])) {
+        continue;
+      }
+      double frac = HighFrac(weights_[lo], w_tgt, weights_[hi]);
+      double hi_frac = AtomToMassFrac(frac, comps_[hi], comps_[lo]);
+      double cost = (1 - hi_frac) * costs_[lo] + hi_frac * costs_[hi];
+      if (found && cost >= best) {
+        continue;
+      }
+      fracs->assign(size(), 0);
+      (*fracs)[hi] = hi_frac;
+      (*fracs)[lo] = 1 - hi_frac;
+      best = cost;
+      found = true;
+      if (uniform_cost_) {
+        return true;
+      }
     }
   }
+  return found;
+}
 
- private:
-  std::string spec_;
-  double w_fiss_;
-  double w_topup_;
-  double w_fill_;
-  Composition::Ptr c_fiss_;
-  Composition::Ptr c_fill_;
-  Composition::Ptr c_topup_;
-};
+void BlendMemo::Add(Material::Ptr offer) {
+  blends_[offer->obj_id()] = Compute(offer);
+}
 
-class TopupConverter : public cyclus::Converter<Material> {
- public:
-  TopupConverter(Composition::Ptr c_fill, Composition::Ptr c_fiss,
-                 Composition::Ptr c_topup, std::string spectrum)
-      : c_fiss_(c_fiss), c_topup_(c_topup), c_fill_(c_fill), spec_(spectrum) {
-    w_fiss_ = CosiWeight(c_fiss, spectrum);
-    w_fill_ = CosiWeight(c_fill, spectrum);
-    w_topup_ = CosiWeight(c_topup, spectrum);
-  }
-
-  virtual ~TopupConverter() {}
-
-  virtual double convert(
-      Material::Ptr m, cyclus::Arc const* a = NULL,
-      cyclus::ExchangeTranslationContext<Material> const* ctx =
-          NULL) const {
-    double w_tgt = CosiWeight(m->comp(), spec_);
-    if (ValidWeights(w_fill_, w_tgt, w_fiss_)) {
-      return 0;
-    } else if (ValidWeights(w_fiss_, w_tgt, w_topup_)) {
-      // switched fissile inventory to filler and topup as fissile
-      double frac = HighFrac(w_fiss_, w_tgt, w_topup_);
-      return AtomToMassFrac(frac, c_topup_, c_fiss_) * m->quantity();
-    } else {
-      // don't bid at all
-      return cyclus::CY_LARGE_DOUBLE;
-    }
+double BlendMemo::Get(Material::Ptr m, int stream) const {
+  std::map<int, std::vector<double> >::const_iterator it =
+      blends_.find(m->obj_id());
+  if (it != blends_.end()) {
+    return it->second[stream];
   }
+  return Compute(m)[stream];
+}
 
- private:
-  std::string spec_;
-  double w_fiss_;
-  double w_topup_;
-  double w_fill_;
-  Composition::Ptr c_fiss_;
-  Composition::Ptr c_fill_;
-  Composition::Ptr c_topup_;
-};
+std::vector<double> BlendMemo::Compute(Material::Ptr m) const {
+  std::vector<double> qtys;
+  if (!blender_.Solve(CosiWeight(m->comp(), spec_), &qtys)) {
+    // don't bid at all
+    qtys.assign(blender_.size(), cyclus::CY_LARGE_DOUBLE);
+    return qtys;
+  }
+  for (int i = 0; i < qtys.size(); i++) {
+    qtys[i] *= m->quantity();
+  }
+  return qtys;
+}
 
 FuelFab::FuelFab(cyclus::Context* ctx)
     : cyclus::Facility(ctx),
@@ -161,6 +143,14 @@ void FuelFab::EnterNotify() {
     throw cyclus::ValidationError(ss.str());
   }
 
+  try {
+    SpectrumFromName(spectrum);
+  } catch (cyclus::ValueError err) {
+    std::stringstream ss;
+    ss << "prototype '" << prototype() << "': " << err.what();
+    throw cyclus::ValidationError(ss.str());
+  }
+
   InitializePosition();
 }
 
@@ -287,71 +277,67 @@ std::set<cyclus::BidPortfolio<Material>::Ptr> FuelFab::GetMatlBids(
     return ports;
   }
 
-  double w_fill = 0;
+  Spectrum spec = SpectrumFromName(spectrum);
   Composition::Ptr
       c_fill;  // no default needed - this is non-optional parameter
   if (fill.count() > 0) {
     c_fill = fill.Peek()->comp();
-    w_fill = CosiWeight(c_fill, spectrum);
   } else {
     c_fill = context()->GetRecipe(fill_recipe);
-    w_fill = CosiWeight(c_fill, spectrum);
   }
 
-  double w_topup = 0;
-  Composition::Ptr c_topup = c_fill;
-  if (topup.count() > 0) {
-    c_topup = topup.Peek()->comp();
-    w_topup = CosiWeight(c_topup, spectrum);
-  } else if (!topup_recipe.empty()) {
-    c_topup = context()->GetRecipe(topup_recipe);
-    w_topup = CosiWeight(c_topup, spectrum);
-  }
-
-  double w_fiss =
-      w_fill;  // this allows trading just fill with no fiss inventory
+  // this allows trading just fill with no fiss inventory
   Composition::Ptr c_fiss = c_fill;
   if (fiss.count() > 0) {
     c_fiss = fiss.Peek()->comp();
-    w_fiss = CosiWeight(c_fiss, spectrum);
   } else if (!fiss_recipe.empty()) {
     c_fiss = context()->GetRecipe(fiss_recipe);
-    w_fiss = CosiWeight(c_fiss, spectrum);
   }
 
+  // streams along with their inventories
+  StreamBlender blender;
+  std::vector<cyclus::toolkit::ResBuf<Material>*> bufs;
+  blender.AddStream(c_fill, CosiWeight(c_fill, spec));
+  bufs.push_back(&fill);
+  blender.AddStream(c_fiss, CosiWeight(c_fiss, spec));
+  bufs.push_back(&fiss);
+  if (topup.count() > 0) {
+    // only bid with topup if we have it - otherwise we might be able to
+    // meet target with filler when we get it. we should only use topup
+    // when the fissile has too poor neutronics.
+    Composition::Ptr c_topup = topup.Peek()->comp();
+    blender.AddStream(c_topup, CosiWeight(c_topup, spec));
+    bufs.push_back(&topup);
+  }
+
+  // blends for each bid are shared by the capacity converters
+  BlendMemo::Ptr memo(new BlendMemo(blender, spec));
+
   BidPortfolio<Material>::Ptr port(new BidPortfolio<Material>());
+  std::vector<double> fracs;
   for (int j = 0; j < reqs.size(); j++) {
     cyclus::Request<Material>* req = reqs[j];
 
-    Composition::Ptr tgt = req->target()->comp();
-    double w_tgt = CosiWeight(tgt, spectrum);
+    double w_tgt = CosiWeight(req->target()->comp(), spec);
     double tgt_qty = req->target()->quantity();
-    if (ValidWeights(w_fill, w_tgt, w_fiss)) {
-      double fiss_frac = HighFrac(w_fill, w_tgt, w_fiss);
-      double fill_frac = 1 - fiss_frac;
-      fiss_frac = AtomToMassFrac(fiss_frac, c_fiss, c_fill);
-      fill_frac = AtomToMassFrac(fill_frac, c_fill, c_fiss);
-      Material::Ptr m1 = Material::CreateUntracked(fiss_frac * tgt_qty, c_fiss);
-      Material::Ptr m2 = Material::CreateUntracked(fill_frac * tgt_qty, c_fill);
-      m1->Absorb(m2);
-
-      bool exclusive = false;
-      port->AddBid(req, m1, this, exclusive);
-    } else if (topup.count() > 0 && ValidWeights(w_fiss, w_tgt, w_topup)) {
-      // only bid with topup if we have filler - otherwise we might be able to
-      // meet target with filler when we get it. we should only use topup
-      // when the fissile has too poor neutronics.
-      double topup_frac = HighFrac(w_fiss, w_tgt, w_topup);
-      double fiss_frac = 1 - topup_frac;
-      fiss_frac = AtomToMassFrac(fiss_frac, c_fiss, c_topup);
-      topup_frac = AtomToMassFrac(topup_frac, c_topup, c_fiss);
-      Material::Ptr m1 =
-          Material::CreateUntracked(topup_frac * tgt_qty, c_topup);
-      Material::Ptr m2 = Material::CreateUntracked(fiss_frac * tgt_qty, c_fiss);
-      m1->Absorb(m2);
+    if (blender.Solve(w_tgt, &fracs)) {
+      Material::Ptr offer;
+      for (int i = blender.size() - 1; i >= 0; i--) {
+        if (fracs[i] <= 0) {
+          continue;
+        }
+        Material::Ptr m =
+            Material::CreateUntracked(fracs[i] * tgt_qty, blender.comp(i));
+        if (!offer) {
+          offer = m;
+        } else {
+          offer->Absorb(m);
+        }
+      }
+      memo->Add(offer);
 
       bool exclusive = false;
-      port->AddBid(req, m1, this, exclusive);
+      port->AddBid(req, offer, this, exclusive);
     } else if (fiss.count() > 0 && fill.count() > 0 ||
                fiss.count() > 0 && topup.count() > 0) {
       // else can't meet the target weight - don't bid.  Just a plain else
@@ -365,23 +351,14 @@ std::set<cyclus::BidPortfolio<Material>::Ptr> FuelFab::GetMatlBids(
     }
   }
 
-  cyclus::Converter<Material>::Ptr fissconv(
-      new FissConverter(c_fill, c_fiss, c_topup, spectrum));
-  cyclus::Converter<Material>::Ptr fillconv(
-      new FillConverter(c_fill, c_fiss, c_topup, spectrum));
-  cyclus::Converter<Material>::Ptr topupconv(
-      new TopupConverter(c_fill, c_fiss, c_topup, spectrum));
   // important! - the std::max calls prevent CapacityConstraint throwing a zero
   // cap exception
-  cyclus::CapacityConstraint<Material> fissc(std::max(fiss.quantity(), cyclus::CY_NEAR_ZERO),
-                                             fissconv);
-  cyclus::CapacityConstraint<Material> fillc(std::max(fill.quantity(), cyclus::CY_NEAR_ZERO),
-                                             fillconv);
-  cyclus::CapacityConstraint<Material> topupc(std::max(topup.quantity(), cyclus::CY_NEAR_ZERO),
-                                              topupconv);
-  port->AddConstraint(fillc);
-  port->AddConstraint(fissc);
-  port->AddConstraint(topupc);
+  for (int i = 0; i < blender.size(); i++) {
+    cyclus::Converter<Material>::Ptr conv(new BlendConverter(memo, i));
+    cyclus::CapacityConstraint<Material> c(
+        std::max(bufs[i]->quantity(), cyclus::CY_NEAR_ZERO), conv);
+    port->AddConstraint(c);
+  }
 
   cyclus::CapacityConstraint<Material> cc(throughput);
   port->AddConstraint(cc);
@@ -395,29 +372,36 @@ void FuelFab::GetMatlTrades(
         responses) {
   using cyclus::Trade;
 
-  // guard against cases where a buffer is empty - this is okay because some
-  // trades may not need that particular buffer.
-  double w_fill = 0;
+  // mix from the streams in stock - this is okay because some trades may
+  // not need a particular buffer.  A trade met from a single stream (e.g.
+  // straight filler with no fissile inventory) is a blend of that stream
+  // alone.
+  Spectrum spec = SpectrumFromName(spectrum);
+  StreamBlender blender;
+  std::vector<cyclus::toolkit::ResBuf<Material>*> bufs;
   if (fill.count() > 0) {
-    w_fill = CosiWeight(fill.Peek()->comp(), spectrum);
-  }
-  double w_topup = 0;
-  if (topup.count() > 0) {
-    w_topup = CosiWeight(topup.Peek()->comp(), spectrum);
+    Composition::Ptr c_fill = fill.Peek()->comp();
+    blender.AddStream(c_fill, CosiWeight(c_fill, spec));
+    bufs.push_back(&fill);
   }
-  double w_fiss = 0;
   if (fiss.count() > 0) {
-    w_fiss = CosiWeight(fiss.Peek()->comp(), spectrum);
+    Composition::Ptr c_fiss = fiss.Peek()->comp();
+    blender.AddStream(c_fiss, CosiWeight(c_fiss, spec));
+    bufs.push_back(&fiss);
+  }
+  if (topup.count() > 0) {
+    Composition::Ptr c_topup = topup.Peek()->comp();
+    blender.AddStream(c_topup, CosiWeight(c_topup, spec));
+    bufs.push_back(&topup);
   }
 
-  std::vector<cyclus::Trade<Material> >::const_iterator it;
+  std::vector<double> fracs;
   double tot = 0;
   for (int i = 0; i < trades.size(); i++) {
     Material::Ptr tgt = trades[i].request->target();
 
-    double w_tgt = CosiWeight(tgt->comp(), spectrum);
+    double w_tgt = CosiWeight(tgt->comp(), spec);
     double qty = trades[i].amt;
-    double wfiss = w_fiss;
 
     tot += qty;
     if (tot > throughput + cyclus::eps_rsrc()) {
@@ -427,68 +411,30 @@ void FuelFab::GetMatlTrades(
       throw cyclus::ValueError(ss.str());
     }
 
-    if (fiss.count() == 0) {
-      // use straight filler to satisfy this request
-      double fillqty = qty;
-      if (std::abs(fillqty - fill.quantity()) < cyclus::eps_rsrc()) {
-        fillqty = std::min(fill.quantity(), qty);
-      }
-      responses.push_back(
-          std::make_pair(trades[i], fill.Pop(fillqty, cyclus::eps_rsrc())));
-    } else if (fill.count() == 0 && ValidWeights(w_fill, w_tgt, w_fiss)) {
-      // use straight fissile to satisfy this request
-      double fissqty = qty;
-      if (std::abs(fissqty - fiss.quantity()) < cyclus::eps_rsrc()) {
-        fissqty = std::min(fiss.quantity(), qty);
-      }
-      responses.push_back(
-          std::make_pair(trades[i], fiss.Pop(fissqty, cyclus::eps_rsrc())));
-    } else if (ValidWeights(w_fill, w_tgt, w_fiss)) {
-      double fiss_frac = HighFrac(w_fill, w_tgt, w_fiss);
-      double fill_frac = LowFrac(w_fill, w_tgt, w_fiss);
-      fiss_frac =
-          AtomToMassFrac(fiss_frac, fiss.Peek()->comp(), fill.Peek()->comp());
-      fill_frac =
-          AtomToMassFrac(fill_frac, fill.Peek()->comp(), fiss.Peek()->comp());
-
-      double fissqty = fiss_frac * qty;
-      if (std::abs(fissqty - fiss.quantity()) < cyclus::eps_rsrc()) {
-        fissqty = std::min(fiss.quantity(), fiss_frac * qty);
-      }
-      double fillqty = fill_frac * qty;
-      if (std::abs(fillqty - fill.quantity()) < cyclus::eps_rsrc()) {
-        fillqty = std::min(fill.quantity(), fill_frac * qty);
-      }
-
-      Material::Ptr m = fiss.Pop(fissqty, cyclus::eps_rsrc());
-      // this if block prevents zero qty ResBuf pop exceptions
-      if (fill_frac > 0) {
-        m->Absorb(fill.Pop(fillqty, cyclus::eps_rsrc()));
+    if (blender.Solve(w_tgt, &fracs)) {
+      Material::Ptr m;
+      for (int j = blender.size() - 1; j >= 0; j--) {
+        // this prevents zero qty ResBuf pop exceptions
+        if (fracs[j] <= 0) {
+          continue;
+        }
+        cyclus::toolkit::ResBuf<Material>* buf = bufs[j];
+        double popqty = fracs[j] * qty;
+        if (std::abs(popqty - buf->quantity()) < cyclus::eps_rsrc()) {
+          popqty = std::min(buf->quantity(), fracs[j] * qty);
+        }
+        if (!m) {
+          m = buf->Pop(popqty, cyclus::eps_rsrc());
+        } else {
+          m->Absorb(buf->Pop(popqty, cyclus::eps_rsrc()));
+        }
       }
       responses.push_back(std::make_pair(trades[i], m));
     } else {
-      double topup_frac = HighFrac(w_fiss, w_tgt, w_topup);
-      double fiss_frac = 1 - topup_frac;
-      topup_frac =
-          AtomToMassFrac(topup_frac, topup.Peek()->comp(), fiss.Peek()->comp());
-      fiss_frac =
-          AtomToMassFrac(fiss_frac, fiss.Peek()->comp(), topup.Peek()->comp());
-
-      double fissqty = fiss_frac * qty;
-      if (std::abs(fissqty - fiss.quantity()) < cyclus::eps_rsrc()) {
-        fissqty = std::min(fiss.quantity(), fiss_frac * qty);
-      }
-      double topupqty = topup_frac * qty;
-      if (std::abs(topupqty - topup.quantity()) < cyclus::eps_rsrc()) {
-        topupqty = std::min(topup.quantity(), topup_frac * qty);
-      }
-
-      Material::Ptr m = fiss.Pop(fissqty, cyclus::eps_rsrc());
-      // this if block prevents zero qty ResBuf pop exceptions
-      if (topup_frac > 0) {
-        m->Absorb(topup.Pop(topupqty, cyclus::eps_rsrc()));
-      }
-      responses.push_back(std::make_pair(trades[i], m));
+      std::stringstream ss;
+      ss << "prototype '" << prototype()
+         << "': input stream weights cannot meet the traded material weight";
+      throw cyclus::ValueError(ss.str());
     }
   }
 }
@@ -497,186 +443,236 @@ extern "C" cyclus::Agent* ConstructFuelFab(cyclus::Context* ctx) {
   return new FuelFab(ctx);
 }
 
-// Returns the weight of c using 1 group cross sections of type spectrum
-// which must be one of:
-//
-//     * thermal
-//     * thermal_maxwell_ave
-//     * fission_spectrum_ave
-//     * resonance_integral
-//     * fourteen_MeV
-//
-// The weight is calculated as "(nu*sigma_f - sigma_a) * N".  Since weights
-// are computed based on nuclide atom fractions, corresponding computed
-// material/mixing fractions will also be atom-based naturally and will need
-// to be converted to mass-based for actual material object mixing.
-double CosiWeight(Composition::Ptr c, const std::string& spectrum) {
-  cyclus::CompMap cm = c->atom();
-  cyclus::compmath::Normalize(&cm);
-
-  if (spectrum == "thermal") {
-    double nu_pu239 = 2.85;
-    double nu_u233 = 2.5;
-    double nu_u235 = 2.43;
-    double nu_u238 = 0;
-    double nu_pu241 = nu_pu239;
-
-    static std::map<int, double> absorb_xs;
-    static std::map<int, double> fiss_xs;
-    static double p_u238 = 0;
-    static double p_pu239 = 0;
-    if (p_u238 == 0) {
-      double fiss_u238 = simple_xs(922380000, "fission", "thermal");
-      double absorb_u238 = simple_xs(922380000, "absorption", "thermal");
-      p_u238 = nu_u238 * fiss_u238 - absorb_u238;
-
-      double fiss_pu239 = simple_xs(942390000, "fission", "thermal");
-      double absorb_pu239 = simple_xs(942390000, "absorption", "thermal");
-      p_pu239 = nu_pu239 * fiss_pu239 - absorb_pu239;
-    }
+namespace {
 
-    cyclus::CompMap::iterator it;
-    double w = 0;
-    for (it = cm.begin(); it != cm.end(); ++it) {
-      cyclus::Nuc nuc = it->first;
-      double nu = 0;
-      if (nuc == 922350000) {
-        nu = nu_u235;
-      } else if (nuc == 922330000) {
-        nu = nu_u233;
-      } else if (nuc == 942390000) {
-        nu = nu_pu239;
-      } else if (nuc == 942410000) {
-        nu = nu_pu241;
-      }
+// Nuclide tables cover every state s < kMaxState of each Z < kMaxZ with a mass
+// number in [max(Z, 2Z - 10), 3Z + 8], which includes every known nuclide and
+// isomer.
+const int kMaxZ = 120;
+const int kMaxState = 10;
 
-      double fiss = 0;
-      double absorb = 0;
-      if (absorb_xs.count(nuc) == 0) {
-        try {
-          fiss = simple_xs(nuc, "fission", "thermal");
-          absorb = simple_xs(nuc, "absorption", "thermal");
-          absorb_xs[nuc] = absorb;
-          fiss_xs[nuc] = fiss;
-        } catch (pyne::InvalidSimpleXS err) {
-          fiss = 0;
-          absorb = 0;
-        }
-      } else {
-        fiss = fiss_xs[nuc];
-        absorb = absorb_xs[nuc];
-      }
+int MinA(int z) { return std::max(z, 2 * z - 10); }
+int MaxA(int z) { return 3 * z + 8; }
 
-      double p = nu * fiss - absorb;
-      w += it->second * (p - p_u238) / (p_pu239 - p_u238);
+// Dense layout of the nuclides covered by the tables.  Entries are ordered by
+// Z, then A, then state.
+class NucBand {
+ public:
+  NucBand() : offsets_(kMaxZ + 1, 0) {
+    for (int z = 0; z < kMaxZ; z++) {
+      offsets_[z + 1] = offsets_[z] + (MaxA(z) - MinA(z) + 1) * kMaxState;
     }
-    return w;
-  } else if (spectrum == "fission_spectrum_ave") {
-    double nu_pu239 = 3.1;
-    double nu_u233 = 2.63;
-    double nu_u235 = 2.58;
-    double nu_u238 = 0;
-    double nu_pu241 = nu_pu239;
-
-    static std::map<int, double> absorb_xs;
-    static std::map<int, double> fiss_xs;
-    static double p_u238 = 0;
-    static double p_pu239 = 0;
-    if (p_u238 == 0) {
-      double fiss_u238 =
-          simple_xs(922380000, "fission", "fission_spectrum_ave");
-      double absorb_u238 =
-          simple_xs(922380000, "absorption", "fission_spectrum_ave");
-      p_u238 = nu_u238 * fiss_u238 - absorb_u238;
-
-      double fiss_pu239 =
-          simple_xs(942390000, "fission", "fission_spectrum_ave");
-      double absorb_pu239 =
-          simple_xs(942390000, "absorption", "fission_spectrum_ave");
-      p_pu239 = nu_pu239 * fiss_pu239 - absorb_pu239;
+  }
+
+  // Returns the number of nuclides in the band.
+  int size() const { return offsets_[kMaxZ]; }
+
+  // Returns the index of nuc in a nuclide table or -1 if it isn't covered.
+  int Index(cyclus::Nuc nuc) const {
+    int z = nuc / 10000000;
+    int a = (nuc / 10000) % 1000;
+    int s = nuc % 10000;
+    if (z < 0 || z >= kMaxZ || a < MinA(z) || a > MaxA(z) || s >= kMaxState) {
+      return -1;
+    }
+    return offsets_[z] + (a - MinA(z)) * kMaxState + s;
+  }
+
+  // Returns the nuclide at index i.
+  cyclus::Nuc Nuc(int i) const {
+    int z = std::upper_bound(offsets_.begin(), offsets_.end(), i) -
+            offsets_.begin() - 1;
+    int a = MinA(z) + (i - offsets_[z]) / kMaxState;
+    int s = (i - offsets_[z]) % kMaxState;
+    return z * 10000000 + a * 10000 + s;
+  }
+
+ private:
+  std::vector<int> offsets_;
+};
+
+const NucBand& Band() {
+  static const NucBand band;
+  return band;
+}
+
+// Number of composition weights memoized per thread (over all spectra)
+// before the oldest are evicted.
+const int kMaxCachedWeights = 1 << 16;
+
+// Per-nuclide COSI weights "(p_i - p_U238) / (p_Pu239 - p_U238)" for a single
+// spectrum.  Cross sections for every nuclide in the band are looked up from
+// PyNE when the table is built and the table is never modified afterwards, so
+// it can be read from any number of threads.
+class ReactivityTable {
+ public:
+  explicit ReactivityTable(Spectrum spectrum)
+      : spectrum_(spectrum), name_(SpectrumName(spectrum)) {
+    double p_u238 = Reactivity(922380000);
+    double p_pu239 = Reactivity(942390000);
+    w_none_ = -p_u238 / (p_pu239 - p_u238);
+
+    const NucBand& band = Band();
+    weights_.resize(band.size());
+    for (int i = 0; i < band.size(); i++) {
+      weights_[i] = (Reactivity(band.Nuc(i)) - p_u238) / (p_pu239 - p_u238);
     }
+  }
+
+  // Returns the weight of nuc.  Nuclides outside of the band are treated as
+  // having no cross sections like nuclides PyNE has no data for.
+  double NucWeight(cyclus::Nuc nuc) const {
+    int i = Band().Index(nuc);
+    return i < 0 ? w_none_ : weights_[i];
+  }
 
-    cyclus::CompMap::iterator it;
+  double Weight(Composition::Ptr c) const {
+    const cyclus::CompMap& cm = c->atom();
+    cyclus::CompMap::const_iterator it;
+    double tot = 0;
     double w = 0;
     for (it = cm.begin(); it != cm.end(); ++it) {
-      cyclus::Nuc nuc = it->first;
-      double nu = 0;
-      if (nuc == 922350000) {
-        nu = nu_u235;
-      } else if (nuc == 922330000) {
-        nu = nu_u233;
-      } else if (nuc == 942390000) {
-        nu = nu_pu239;
-      } else if (nuc == 942410000) {
-        nu = nu_pu241;
-      }
+      tot += it->second;
+      w += it->second * NucWeight(it->first);
+    }
+    if (tot > 0) {
+      w /= tot;
+    }
+    return w;
+  }
 
-      double fiss = 0;
-      double absorb = 0;
-      if (absorb_xs.count(nuc) == 0) {
-        try {
-          fiss = simple_xs(nuc, "fission", "fission_spectrum_ave");
-          absorb = simple_xs(nuc, "absorption", "fission_spectrum_ave");
-          absorb_xs[nuc] = absorb;
-          fiss_xs[nuc] = fiss;
-        } catch (pyne::InvalidSimpleXS err) {
-          fiss = 0;
-          absorb = 0;
-        }
-      } else {
-        fiss = fiss_xs[nuc];
-        absorb = absorb_xs[nuc];
-      }
+ private:
+  // Returns "nu*sigma_f - sigma_a" for nuc.
+  double Reactivity(cyclus::Nuc nuc) const {
+    double nu = 0;
+    if (nuc == 922350000) {
+      nu = spectrum_ == kThermal ? 2.43 : 2.58;
+    } else if (nuc == 922330000) {
+      nu = spectrum_ == kThermal ? 2.5 : 2.63;
+    } else if (nuc == 942390000 || nuc == 942410000) {
+      nu = spectrum_ == kThermal ? 2.85 : 3.1;
+    }
+    try {
+      return nu * simple_xs(nuc, "fission", name_) -
+             simple_xs(nuc, "absorption", name_);
+    } catch (std::exception& err) {
+      // no data or not a nuclide PyNE knows about
+      return 0;
+    }
+  }
 
-      double p = nu * fiss - absorb;
-      w += it->second * (p - p_u238) / (p_pu239 - p_u238);
+  Spectrum spectrum_;
+  std::string name_;
+  double w_none_;
+  std::vector<double> weights_;
+};
+
+// Reactivity tables for all spectra and atomic masses for every nuclide in
+// the band.  They are built together, once, because PyNE lazily loads (and
+// caches) its nuclear data and so must not be called from several threads.
+// Nothing is modified afterwards, so no locking is needed to read them.
+struct NuclideData {
+  NuclideData() {
+    for (int i = 0; i < kNSpectra; i++) {
+      tables.push_back(ReactivityTable(static_cast<Spectrum>(i)));
     }
-    return w;
-  } else {
-    double nu_pu239 = 3.1;
-    double nu_u233 = 2.63;
-    double nu_u235 = 2.58;
-    double nu_u238 = 0;
-    double nu_pu241 = nu_pu239;
+    const NucBand& band = Band();
+    masses.resize(band.size());
+    for (int i = 0; i < band.size(); i++) {
+      masses[i] = pyne::atomic_mass(band.Nuc(i));
+    }
+  }
 
-    double fiss_u238 = simple_xs(922380000, "fission", spectrum);
-    double absorb_u238 = simple_xs(922380000, "absorption", spectrum);
-    double p_u238 = nu_u238 * fiss_u238 - absorb_u238;
+  std::vector<ReactivityTable> tables;
+  std::vector<double> masses;
+};
 
-    double fiss_pu239 = simple_xs(942390000, "fission", spectrum);
-    double absorb_pu239 = simple_xs(942390000, "absorption", spectrum);
-    double p_pu239 = nu_pu239 * fiss_pu239 - absorb_pu239;
+// function local statics are initialized exactly once, even when first used
+// from several threads at the same time
+const NuclideData& Data() {
+  static const NuclideData data;
+  return data;
+}
 
-    cyclus::CompMap::iterator it;
-    double w = 0;
-    for (it = cm.begin(); it != cm.end(); ++it) {
-      cyclus::Nuc nuc = it->first;
-      double nu = 0;
-      if (nuc == 922350000) {
-        nu = nu_u235;
-      } else if (nuc == 922330000) {
-        nu = nu_u233;
-      } else if (nuc == 942390000) {
-        nu = nu_pu239;
-      } else if (nuc == 942410000) {
-        nu = nu_pu241;
-      }
+// Returns the atomic mass of nuc, using its mass number for nuclides outside
+// of the band like PyNE does for nuclides without data.
+double AtomicMass(cyclus::Nuc nuc) {
+  int i = Band().Index(nuc);
+  return i < 0 ? (nuc / 10000) % 1000 : Data().masses[i];
+}
 
-      double fiss = 0;
-      double absorb = 0;
-      try {
-        fiss = simple_xs(nuc, "fission", spectrum);
-        absorb = simple_xs(nuc, "absorption", spectrum);
-      } catch (pyne::InvalidSimpleXS err) {
-        fiss = 0;
-        absorb = 0;
-      }
+}  // namespace
 
-      double p = nu * fiss - absorb;
-      w += it->second * (p - p_u238) / (p_pu239 - p_u238);
+Spectrum SpectrumFromName(const std::string& name) {
+  for (int i = 0; i < kNSpectra; i++) {
+    if (name == SpectrumName(static_cast<Spectrum>(i))) {
+      return static_cast<Spectrum>(i);
     }
-    return w;
   }
+  std::stringstream ss;
+  ss << "unknown cross section spectrum '" << name << "'";
+  throw cyclus::ValueError(ss.str());
+}
+
+std::string SpectrumName(Spectrum spectrum) {
+  switch (spectrum) {
+    case kThermal:
+      return "thermal";
+    case kThermalMaxwellAve:
+      return "thermal_maxwell_ave";
+    case kFissionSpectrumAve:
+      return "fission_spectrum_ave";
+    case kResonanceIntegral:
+      return "resonance_integral";
+    case kFourteenMeV:
+      return "fourteen_MeV";
+    default:
+      throw cyclus::ValueError("invalid cross section spectrum");
+  }
+}
+
+// Returns the weight of c using 1 group cross sections of the given spectrum.
+//
+// The weight is calculated as "(nu*sigma_f - sigma_a) * N".  Since weights
+// are computed based on nuclide atom fractions, corresponding computed
+// material/mixing fractions will also be atom-based naturally and will need
+// to be converted to mass-based for actual material object mixing.
+double CosiWeight(Composition::Ptr c, Spectrum spectrum) {
+  if (spectrum < 0 || spectrum >= kNSpectra) {
+    throw cyclus::ValueError("invalid cross section spectrum");
+  }
+
+  // each thread keeps its own cache so no locking is needed.  When the cache
+  // is full only the oldest entry is evicted.
+  typedef std::pair<int, int> Key;
+  static thread_local std::map<Key, double> weights;
+  static thread_local std::deque<Key> order;
+  Key key(spectrum, c->id());
+  std::map<Key, double>::iterator it = weights.find(key);
+  if (it != weights.end()) {
+    return it->second;
+  }
+
+  double w = Data().tables[spectrum].Weight(c);
+  if (weights.size() >= kMaxCachedWeights) {
+    weights.erase(order.front());
+    order.pop_front();
+  }
+  weights[key] = w;
+  order.push_back(key);
+  return w;
+}
+
+// Returns the weight of c using 1 group cross sections of type spectrum
+// which must be one of:
+//
+//     * thermal
+//     * thermal_maxwell_ave
+//     * fission_spectrum_ave
+//     * resonance_integral
+//     * fourteen_MeV
+double CosiWeight(Composition::Ptr c, const std::string& spectrum) {
+  return CosiWeight(c, SpectrumFromName(spectrum));
 }
 
 // Convert an atom frac (n1/(n1+n2) to a mass frac (m1/(m1+m2) given
@@ -692,12 +688,12 @@ double AtomToMassFrac(double atomfrac, Composition::Ptr c1,
 
   double mass1 = 0;
   for (it = n1.begin(); it != n1.end(); ++it) {
-    mass1 += it->second * pyne::atomic_mass(it->first);
+    mass1 += it->second * AtomicMass(it->first);
   }
 
   double mass2 = 0;
   for (it = n2.begin(); it != n2.end(); ++it) {
-    mass2 += it->second * pyne::atomic_mass(it->first);
+    mass2 += it->second * AtomicMass(it->first);
   }
 
   return mass1 / (mass1 + mass2);
@@ -271,12 +271,122 @@ class FuelFab
 
 };
 
+/// One group cross section spectra available from the PyNE simple cross
+/// section library.
+enum Spectrum {
+  kThermal = 0,
+  kThermalMaxwellAve,
+  kFissionSpectrumAve,
+  kResonanceIntegral,
+  kFourteenMeV,
+  kNSpectra,
+};
+
+/// Returns the spectrum with the given PyNE name (e.g. "thermal").  Throws
+/// cyclus::ValueError for unknown names.
+Spectrum SpectrumFromName(const std::string& name);
+
+/// Returns the PyNE name of the given spectrum.
+std::string SpectrumName(Spectrum spectrum);
+
+double CosiWeight(cyclus::Composition::Ptr c, Spectrum spectrum);
 double CosiWeight(cyclus::Composition::Ptr c, const std::string& spectrum);
 bool ValidWeights(double w_low, double w_tgt, double w_high);
 double LowFrac(double w_low, double w_tgt, double w_high, double eps = cyclus::CY_NEAR_ZERO);
 double HighFrac(double w_low, double w_tgt, double w_high, double eps = cyclus::CY_NEAR_ZERO);
 double AtomToMassFrac(double atomfrac, cyclus::Composition::Ptr c1, cyclus::Composition::Ptr c2);
 
+/// Equivalence blending of any number of inventory streams.  Each stream has
+/// a weight and a cost per unit mass, and a target weight is met by the
+/// cheapest blend of streams.  Since blends are linear in the stream masses,
+/// the cheapest blend is always either a single stream of the target weight
+/// or a mix of one stream below and one above it, so every target between the
+/// lowest and highest stream weight can be met.  At equal cost the fewest
+/// streams of nearest weight to the target are used, and streams of equal
+/// weight are used in the order they were added.
+class StreamBlender {
+ public:
+  StreamBlender() : uniform_cost_(true) {}
+
+  /// Adds a stream with composition c, weight w and cost per unit mass cost
+  /// and returns its index.
+  int AddStream(cyclus::Composition::Ptr c, double w, double cost = 0);
+
+  int size() const { return weights_.size(); }
+  double weight(int i) const { return weights_[i]; }
+  double cost(int i) const { return costs_[i]; }
+  cyclus::Composition::Ptr comp(int i) const { return comps_[i]; }
+
+  /// Sets fracs to the mass fraction of each stream (by index) in the
+  /// cheapest blend matching weight w_tgt.  Returns false (with all fractions
+  /// zero) if w_tgt is outside the range of stream weights.
+  bool Solve(double w_tgt, std::vector<double>* fracs) const;
+
+ private:
+  std::vector<double> weights_;
+  std::vector<double> costs_;
+  std::vector<cyclus::Composition::Ptr> comps_;
+  // stream indices in order of increasing weight
+  std::vector<int> by_weight_;
+  // true if all streams have the same cost
+  bool uniform_cost_;
+};
+
+/// Blends of FuelFab inventories for requested materials.  The blends for a
+/// FuelFab's bids are computed once while bidding and shared by its capacity
+/// converters, so constraining an arc takes a single weight evaluation and
+/// fraction solve instead of one of each per converter.  Blends are keyed by
+/// bid offer, of which there is one per request.  The memo isn't modified
+/// after bidding and can be read from several threads.
+class BlendMemo {
+ public:
+  typedef boost::shared_ptr<BlendMemo> Ptr;
+
+  BlendMemo(const StreamBlender& blender, Spectrum spectrum)
+      : blender_(blender), spec_(spectrum) {}
+
+  /// Computes and stores the blend for the given bid offer.
+  void Add(cyclus::Material::Ptr offer);
+
+  /// Returns the quantity of the given stream in the blend for m, computing
+  /// the blend if m was not added.  Returns CY_LARGE_DOUBLE if the streams
+  /// can't be mixed to the weight of m.
+  double Get(cyclus::Material::Ptr m, int stream) const;
+
+  int size() const { return blends_.size(); }
+
+ private:
+  /// Returns the quantity of each stream in the blend for m.
+  std::vector<double> Compute(cyclus::Material::Ptr m) const;
+
+  StreamBlender blender_;
+  Spectrum spec_;
+
+  // keyed by material object id
+  std::map<int, std::vector<double> > blends_;
+};
+
+/// Capacity converter for the inventory constraint of one blending stream
+/// of FuelFab bids.  Returns the stream's quantity in the blend for the given
+/// material.
+class BlendConverter : public cyclus::Converter<cyclus::Material> {
+ public:
+  BlendConverter(BlendMemo::Ptr memo, int stream)
+      : memo_(memo), stream_(stream) {}
+  virtual ~BlendConverter() {}
+
+  virtual double convert(
+      cyclus::Material::Ptr m, cyclus::Arc const* a = NULL,
+      cyclus::ExchangeTranslationContext<cyclus::Material> const* ctx =
+          NULL) const {
+    return memo_->Get(m, stream_);
+  }
+
+ private:
+  BlendMemo::Ptr memo_;
+  int stream_;
+};
+
 } // namespace cycamore
 
 
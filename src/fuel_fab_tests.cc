@@ -1,7 +1,9 @@
 #include "fuel_fab.h"
 
 #include <gtest/gtest.h>
+#include <chrono>
 #include <sstream>
+#include <thread>
 #include "cyclus.h"
 
 using pyne::nucname::id;
@@ -140,6 +142,484 @@ TEST(FuelFabTests, CosiWeight_Mixed) {
   EXPECT_LT(std::abs((w_target-got)/w_target), 0.00001) << "mixed composition not within 0.001% of target";
 }
 
+// Spent fuel like composition with ~300 fission products and actinides.
+Composition::Ptr c_spentfuel() {
+  CompMap m;
+  for (int z = 32; z <= 64; z++) {
+    int a0 = static_cast<int>(2.4 * z) - 4;
+    for (int a = a0; a < a0 + 9; a++) {
+      m[z * 10000000 + a * 10000] = 1e-3 * (1 + (z + a) % 7);
+    }
+  }
+  m[922350000] = 0.8;
+  m[922360000] = 0.4;
+  m[922380000] = 93;
+  m[932370000] = 0.05;
+  m[942380000] = 0.02;
+  m[942390000] = 0.6;
+  m[942400000] = 0.25;
+  m[942410000] = 0.15;
+  m[942420000] = 0.06;
+  m[952410000] = 0.01;
+  return Composition::CreateFromAtom(m);
+};
+
+// Computes the weight from scratch, looking up every cross section on every
+// call.
+double RefCosiWeight(Composition::Ptr c, const std::string& spectrum) {
+  using pyne::simple_xs;
+  CompMap cm = c->atom();
+  cyclus::compmath::Normalize(&cm);
+
+  double nu_pu239 = spectrum == "thermal" ? 2.85 : 3.1;
+  double nu_u233 = spectrum == "thermal" ? 2.5 : 2.63;
+  double nu_u235 = spectrum == "thermal" ? 2.43 : 2.58;
+  double p_u238 = -simple_xs(922380000, "absorption", spectrum);
+  double p_pu239 = nu_pu239 * simple_xs(942390000, "fission", spectrum) -
+                   simple_xs(942390000, "absorption", spectrum);
+
+  double w = 0;
+  for (CompMap::iterator it = cm.begin(); it != cm.end(); ++it) {
+    int nuc = it->first;
+    double nu = 0;
+    if (nuc == 922350000) {
+      nu = nu_u235;
+    } else if (nuc == 922330000) {
+      nu = nu_u233;
+    } else if (nuc == 942390000 || nuc == 942410000) {
+      nu = nu_pu239;
+    }
+    double p = 0;
+    try {
+      p = nu * simple_xs(nuc, "fission", spectrum) -
+          simple_xs(nuc, "absorption", spectrum);
+    } catch (pyne::InvalidSimpleXS err) {
+      p = 0;
+    }
+    w += it->second * (p - p_u238) / (p_pu239 - p_u238);
+  }
+  return w;
+}
+
+TEST(FuelFabTests, CosiWeight_Spectra) {
+  cyclus::Env::SetNucDataPath();
+  EXPECT_THROW(SpectrumFromName("epithermal"), cyclus::ValueError);
+  for (int i = 0; i < kNSpectra; i++) {
+    Spectrum spec = static_cast<Spectrum>(i);
+    std::string name = SpectrumName(spec);
+    EXPECT_EQ(spec, SpectrumFromName(name));
+
+    Composition::Ptr c = c_spentfuel();
+    double want = RefCosiWeight(c, name);
+    EXPECT_NEAR(want, CosiWeight(c, spec), 1e-12 * std::abs(want)) << name;
+    EXPECT_DOUBLE_EQ(CosiWeight(c, spec), CosiWeight(c, name)) << name;
+  }
+}
+
+// Compares the per-call cost of computing spent fuel weights from scratch
+// against table lookups (new compositions) and cached weights (repeated
+// compositions).
+TEST(FuelFabTests, CosiWeight_Cache) {
+  cyclus::Env::SetNucDataPath();
+  CompMap m = c_spentfuel()->atom();
+  int n = 200;
+  std::vector<Composition::Ptr> comps;
+  for (int i = 0; i < n; i++) {
+    comps.push_back(Composition::CreateFromAtom(m));
+  }
+  CosiWeight(c_spentfuel(), kThermal);
+
+  std::vector<double> want(n);
+  std::chrono::steady_clock::time_point start =
+      std::chrono::steady_clock::now();
+  for (int i = 0; i < n; i++) {
+    want[i] = RefCosiWeight(comps[i], "thermal");
+  }
+  std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+  double ref_ns = std::chrono::duration<double, std::nano>(end - start).count();
+
+  std::vector<double> got(n);
+  start = std::chrono::steady_clock::now();
+  for (int i = 0; i < n; i++) {
+    got[i] = CosiWeight(comps[i], kThermal);
+  }
+  end = std::chrono::steady_clock::now();
+  double table_ns = std::chrono::duration<double, std::nano>(end - start).count();
+
+  int reps = 100;
+  double sum = 0;
+  start = std::chrono::steady_clock::now();
+  for (int r = 0; r < reps; r++) {
+    for (int i = 0; i < n; i++) {
+      sum += CosiWeight(comps[i], kThermal);
+    }
+  }
+  end = std::chrono::steady_clock::now();
+  double cached_ns = std::chrono::duration<double, std::nano>(end - start).count();
+
+  for (int i = 0; i < n; i++) {
+    EXPECT_NEAR(want[i], got[i], 1e-12 * std::abs(want[i]));
+  }
+  EXPECT_NEAR(reps * n * got[0], sum, 1e-9 * std::abs(sum));
+
+  RecordProperty("NuclidesPerComposition", static_cast<int>(m.size()));
+  RecordProperty("UncachedNanoseconds", static_cast<int>(ref_ns / n));
+  RecordProperty("TableNanoseconds", static_cast<int>(table_ns / n));
+  RecordProperty("CachedNanoseconds",
+                 static_cast<int>(cached_ns / (reps * n)));
+}
+
+// Evaluates weights and all three converters for many targets from several
+// threads at once and checks them against single threaded results.  Build
+// with -DUSE_TSAN=ON to have ThreadSanitizer check for data races.
+TEST(FuelFabTests, CosiWeight_Threads) {
+  cyclus::Env::SetNucDataPath();
+  Composition::Ptr c_fill = c_natu();
+  Composition::Ptr c_fiss = c_pustreamlow();
+  Composition::Ptr c_topup = c_pustream();
+
+  int n_tgt = 64;
+  std::vector<Material::Ptr> tgts;
+  for (int i = 0; i < n_tgt; i++) {
+    CompMap m;
+    m[922350000] = 0.7 + 0.01 * i;
+    m[922380000] = 100;
+    m[942390000] = 0.2 * i;
+    m[942400000] = 0.02 * i;
+    m[551370000] = 0.1;
+    Composition::Ptr c = Composition::CreateFromMass(m);
+    tgts.push_back(Material::CreateUntracked(1 + i, c));
+  }
+  tgts.push_back(Material::CreateUntracked(1, c_spentfuel()));
+
+  // memoize half of the blends to exercise both lookups and computing
+  std::vector<cyclus::Converter<Material>::Ptr> convs;
+  for (int s = 0; s < kNSpectra; s++) {
+    Spectrum spec = static_cast<Spectrum>(s);
+    StreamBlender blender;
+    blender.AddStream(c_fill, CosiWeight(c_fill, spec));
+    blender.AddStream(c_fiss, CosiWeight(c_fiss, spec));
+    blender.AddStream(c_topup, CosiWeight(c_topup, spec));
+    BlendMemo::Ptr memo(new BlendMemo(blender, spec));
+    for (int i = 0; i < tgts.size(); i += 2) {
+      memo->Add(tgts[i]);
+    }
+    for (int k = 0; k < blender.size(); k++) {
+      convs.push_back(
+          cyclus::Converter<Material>::Ptr(new BlendConverter(memo, k)));
+    }
+  }
+
+  // compositions compute their atom fractions lazily, so do that up front
+  std::vector<double> want_w;
+  std::vector<double> want_conv;
+  for (int i = 0; i < tgts.size(); i++) {
+    tgts[i]->comp()->atom();
+    for (int s = 0; s < kNSpectra; s++) {
+      want_w.push_back(CosiWeight(tgts[i]->comp(), static_cast<Spectrum>(s)));
+    }
+    for (int j = 0; j < convs.size(); j++) {
+      want_conv.push_back(convs[j]->convert(tgts[i]));
+    }
+  }
+
+  int n_threads = 8;
+  int reps = 20;
+  std::vector<int> n_wrong(n_threads, 0);
+  std::vector<std::thread> threads;
+  for (int t = 0; t < n_threads; t++) {
+    threads.push_back(std::thread([&, t]() {
+      for (int r = 0; r < reps; r++) {
+        for (int i = 0; i < tgts.size(); i++) {
+          // start each thread at a different target to interleave more
+          int k = (i + t * 7) % tgts.size();
+          for (int s = 0; s < kNSpectra; s++) {
+            double w = CosiWeight(tgts[k]->comp(), static_cast<Spectrum>(s));
+            if (w != want_w[k * kNSpectra + s]) {
+              n_wrong[t]++;
+            }
+          }
+          for (int j = 0; j < convs.size(); j++) {
+            if (convs[j]->convert(tgts[k]) != want_conv[k * convs.size() + j]) {
+              n_wrong[t]++;
+            }
+          }
+        }
+      }
+    }));
+  }
+  for (int t = 0; t < n_threads; t++) {
+    threads[t].join();
+  }
+
+  for (int t = 0; t < n_threads; t++) {
+    EXPECT_EQ(0, n_wrong[t]) << "thread " << t;
+  }
+}
+
+// Tests that targets are blended from the pair of streams of nearest weight
+// that spans them, for any number of streams.
+TEST(FuelFabTests, StreamBlender) {
+  cyclus::Env::SetNucDataPath();
+  std::vector<Composition::Ptr> comps;
+  comps.push_back(c_natu());
+  comps.push_back(c_uox());
+  comps.push_back(c_pustreamlow());
+  comps.push_back(c_pustream());
+
+  StreamBlender blender;
+  for (int i = 0; i < comps.size(); i++) {
+    EXPECT_EQ(i, blender.AddStream(comps[i], CosiWeight(comps[i], kThermal)));
+  }
+
+  std::vector<double> fracs;
+  for (int lo = 0; lo + 1 < blender.size(); lo++) {
+    double w_tgt = (blender.weight(lo) + 3 * blender.weight(lo + 1)) / 4;
+    ASSERT_TRUE(blender.Solve(w_tgt, &fracs));
+    ASSERT_EQ(blender.size(), fracs.size());
+
+    Material::Ptr m = Material::CreateUntracked(fracs[lo], comps[lo]);
+    m->Absorb(Material::CreateUntracked(fracs[lo + 1], comps[lo + 1]));
+    EXPECT_NEAR(1, m->quantity(), 1e-12);
+    EXPECT_NEAR(w_tgt, CosiWeight(m->comp(), kThermal), 1e-9);
+    for (int i = 0; i < blender.size(); i++) {
+      if (i != lo && i != lo + 1) {
+        EXPECT_EQ(0, fracs[i]);
+      }
+    }
+  }
+
+  // exactly the weight of a shared stream uses the lower pair
+  ASSERT_TRUE(blender.Solve(blender.weight(1), &fracs));
+  EXPECT_DOUBLE_EQ(0, fracs[0]);
+  EXPECT_DOUBLE_EQ(1, fracs[1]);
+
+  EXPECT_FALSE(blender.Solve(blender.weight(3) + 1, &fracs));
+  EXPECT_FALSE(blender.Solve(blender.weight(0) - 1, &fracs));
+  EXPECT_EQ(std::vector<double>(blender.size(), 0), fracs);
+
+  // streams added out of weight order are still blended with their nearest
+  // neighbours by weight
+  StreamBlender unsorted;
+  unsorted.AddStream(comps[3], blender.weight(3));
+  unsorted.AddStream(comps[0], blender.weight(0));
+  unsorted.AddStream(comps[1], blender.weight(1));
+  double w_tgt = (blender.weight(0) + blender.weight(1)) / 2;
+  ASSERT_TRUE(unsorted.Solve(w_tgt, &fracs));
+  EXPECT_EQ(0, fracs[0]);
+  EXPECT_LT(0, fracs[1]);
+  EXPECT_LT(0, fracs[2]);
+  EXPECT_NEAR(1, fracs[1] + fracs[2], 1e-12);
+
+  // an expensive stream is passed over for a cheaper blend further away in
+  // weight, even where it alone has the target weight
+  StreamBlender costly;
+  for (int i = 0; i < comps.size(); i++) {
+    costly.AddStream(comps[i], blender.weight(i), i == 1 ? 10 : 1);
+  }
+  for (int k = 0; k < 2; k++) {
+    w_tgt = k == 0 ? (blender.weight(0) + blender.weight(1)) / 2
+                   : blender.weight(1);
+    ASSERT_TRUE(costly.Solve(w_tgt, &fracs));
+    EXPECT_EQ(0, fracs[1]);
+    EXPECT_EQ(0, fracs[3]);
+    Material::Ptr m = Material::CreateUntracked(fracs[0], comps[0]);
+    m->Absorb(Material::CreateUntracked(fracs[2], comps[2]));
+    EXPECT_NEAR(1, m->quantity(), 1e-12);
+    EXPECT_NEAR(w_tgt, CosiWeight(m->comp(), kThermal), 1e-9);
+  }
+
+  // a single stream meets its own weight
+  StreamBlender single;
+  single.AddStream(comps[0], blender.weight(0));
+  ASSERT_TRUE(single.Solve(blender.weight(0), &fracs));
+  EXPECT_EQ(std::vector<double>(1, 1), fracs);
+  EXPECT_FALSE(single.Solve(blender.weight(1), &fracs));
+}
+
+// Thermal weight as computed before weights were memoized - the atom
+// composition is copied and normalized and cross sections are looked up in
+// maps on every call.
+double PreMemoCosiWeight(Composition::Ptr c) {
+  using pyne::simple_xs;
+  CompMap cm = c->atom();
+  cyclus::compmath::Normalize(&cm);
+
+  static std::map<int, double> absorb_xs;
+  static std::map<int, double> fiss_xs;
+  static double p_u238 = -simple_xs(922380000, "absorption", "thermal");
+  static double p_pu239 = 2.85 * simple_xs(942390000, "fission", "thermal") -
+                          simple_xs(942390000, "absorption", "thermal");
+
+  double w = 0;
+  for (CompMap::iterator it = cm.begin(); it != cm.end(); ++it) {
+    int nuc = it->first;
+    double nu = 0;
+    if (nuc == 922350000) {
+      nu = 2.43;
+    } else if (nuc == 922330000) {
+      nu = 2.5;
+    } else if (nuc == 942390000 || nuc == 942410000) {
+      nu = 2.85;
+    }
+    if (absorb_xs.count(nuc) == 0) {
+      try {
+        fiss_xs[nuc] = simple_xs(nuc, "fission", "thermal");
+        absorb_xs[nuc] = simple_xs(nuc, "absorption", "thermal");
+      } catch (pyne::InvalidSimpleXS err) {
+        fiss_xs[nuc] = 0;
+        absorb_xs[nuc] = 0;
+      }
+    }
+    double p = nu * fiss_xs[nuc] - absorb_xs[nuc];
+    w += it->second * (p - p_u238) / (p_pu239 - p_u238);
+  }
+  return w;
+}
+
+// The fill (0), fiss (1) and topup (2) capacity converters FuelFab used before
+// blends were memoized.  Each one evaluates the target weight and solves the
+// blend for its own stream.
+class PreMemoConverter : public cyclus::Converter<Material> {
+ public:
+  PreMemoConverter(Composition::Ptr c_fill, Composition::Ptr c_fiss,
+                   Composition::Ptr c_topup, int stream)
+      : c_fill_(c_fill), c_fiss_(c_fiss), c_topup_(c_topup), stream_(stream) {
+    w_fill_ = PreMemoCosiWeight(c_fill);
+    w_fiss_ = PreMemoCosiWeight(c_fiss);
+    w_topup_ = PreMemoCosiWeight(c_topup);
+  }
+
+  virtual double convert(
+      Material::Ptr m, cyclus::Arc const* a = NULL,
+      cyclus::ExchangeTranslationContext<Material> const* ctx = NULL) const {
+    double w_tgt = PreMemoCosiWeight(m->comp());
+    if (ValidWeights(w_fill_, w_tgt, w_fiss_)) {
+      if (stream_ == 0) {
+        double frac = LowFrac(w_fill_, w_tgt, w_fiss_);
+        return AtomToMassFrac(frac, c_fill_, c_fiss_) * m->quantity();
+      } else if (stream_ == 1) {
+        double frac = HighFrac(w_fill_, w_tgt, w_fiss_);
+        return AtomToMassFrac(frac, c_fiss_, c_fill_) * m->quantity();
+      }
+      return 0;
+    } else if (ValidWeights(w_fiss_, w_tgt, w_topup_)) {
+      if (stream_ == 1) {
+        double frac = LowFrac(w_fiss_, w_tgt, w_topup_);
+        return AtomToMassFrac(frac, c_fiss_, c_topup_) * m->quantity();
+      } else if (stream_ == 2) {
+        double frac = HighFrac(w_fiss_, w_tgt, w_topup_);
+        return AtomToMassFrac(frac, c_topup_, c_fiss_) * m->quantity();
+      }
+      return 0;
+    }
+    return cyclus::CY_LARGE_DOUBLE;
+  }
+
+ private:
+  Composition::Ptr c_fill_;
+  Composition::Ptr c_fiss_;
+  Composition::Ptr c_topup_;
+  double w_fill_;
+  double w_fiss_;
+  double w_topup_;
+  int stream_;
+};
+
+// Compares constraining every arc between 500 reactor requests and 20 fuel
+// fabs with the three independent converters FuelFab used before (three
+// weight evaluations and fraction solves per arc) against blends memoized once
+// per bid.
+TEST(FuelFabTests, BlendMemo) {
+  cyclus::Env::SetNucDataPath();
+  int n_fabs = 20;
+  int n_reqs = 500;
+
+  std::vector<Composition::Ptr> tgts;
+  for (int i = 0; i < n_reqs; i++) {
+    CompMap m;
+    m[922350000] = 0.7;
+    m[922380000] = 100;
+    m[942390000] = 2 + 0.004 * i;
+    m[942400000] = 0.3;
+    tgts.push_back(Composition::CreateFromMass(m));
+  }
+
+  Composition::Ptr c_fill = c_natu();
+  Composition::Ptr c_topup = c_pustream();
+  std::vector<Composition::Ptr> c_fiss;
+  std::vector<BlendMemo::Ptr> memos;
+  std::vector<std::vector<Material::Ptr> > offers(n_fabs);
+  for (int f = 0; f < n_fabs; f++) {
+    CompMap m;
+    m[942390000] = 60 + f;
+    m[942400000] = 10;
+    m[942410000] = 1;
+    c_fiss.push_back(Composition::CreateFromMass(m));
+    StreamBlender blender;
+    blender.AddStream(c_fill, CosiWeight(c_fill, kThermal));
+    blender.AddStream(c_fiss[f], CosiWeight(c_fiss[f], kThermal));
+    blender.AddStream(c_topup, CosiWeight(c_topup, kThermal));
+    memos.push_back(BlendMemo::Ptr(new BlendMemo(blender, kThermal)));
+    for (int i = 0; i < n_reqs; i++) {
+      offers[f].push_back(Material::CreateUntracked(1000, tgts[i]));
+    }
+  }
+
+  std::vector<double> want;
+  std::chrono::steady_clock::time_point start =
+      std::chrono::steady_clock::now();
+  for (int f = 0; f < n_fabs; f++) {
+    PreMemoConverter fill(c_fill, c_fiss[f], c_topup, 0);
+    PreMemoConverter fiss(c_fill, c_fiss[f], c_topup, 1);
+    PreMemoConverter topup(c_fill, c_fiss[f], c_topup, 2);
+    for (int i = 0; i < n_reqs; i++) {
+      want.push_back(fiss.convert(offers[f][i]));
+      want.push_back(fill.convert(offers[f][i]));
+      want.push_back(topup.convert(offers[f][i]));
+    }
+  }
+  std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+  double computed_ns =
+      std::chrono::duration<double, std::nano>(end - start).count();
+
+  std::vector<double> got;
+  start = std::chrono::steady_clock::now();
+  for (int f = 0; f < n_fabs; f++) {
+    for (int i = 0; i < n_reqs; i++) {
+      memos[f]->Add(offers[f][i]);
+    }
+    BlendConverter fill(memos[f], 0);
+    BlendConverter fiss(memos[f], 1);
+    BlendConverter topup(memos[f], 2);
+    for (int i = 0; i < n_reqs; i++) {
+      got.push_back(fiss.convert(offers[f][i]));
+      got.push_back(fill.convert(offers[f][i]));
+      got.push_back(topup.convert(offers[f][i]));
+    }
+  }
+  end = std::chrono::steady_clock::now();
+  double memo_ns = std::chrono::duration<double, std::nano>(end - start).count();
+
+  ASSERT_EQ(want.size(), got.size());
+  int n_bid = 0;
+  for (int i = 0; i < want.size(); i++) {
+    EXPECT_NEAR(want[i], got[i], 1e-9 * std::max(1.0, std::abs(want[i])));
+    if (got[i] < cyclus::CY_LARGE_DOUBLE) {
+      n_bid++;
+    }
+  }
+  EXPECT_GT(n_bid, 0);
+  EXPECT_EQ(n_reqs, memos[0]->size());
+
+  int n_arcs = n_fabs * n_reqs;
+  RecordProperty("Arcs", n_arcs);
+  RecordProperty("PerConverterNanosecondsPerArc",
+                 static_cast<int>(computed_ns / n_arcs));
+  RecordProperty("MemoizedNanosecondsPerArc",
+                 static_cast<int>(memo_ns / n_arcs));
+}
+
 TEST(FuelFabTests, HighFrac) {
   cyclus::Env::SetNucDataPath();
   double w_fill = CosiWeight(c_natu(), "thermal");
@@ -1,9 +1,141 @@
+#include <algorithm>
 #include <sstream>
 
 #include "mixer.h"
 
 namespace cycamore {
 
+namespace {
+
+const double kLPEps = 1e-12;
+
+// Maximizes c.x subject to A x <= b and x >= 0. b must be non-negative so the
+// origin is a feasible start. This is a dense tableau simplex using Bland's
+// rule, since blending problems have many degenerate vertices on which the
+// usual most-negative rule can cycle.
+std::vector<double> MaximizeLP(const std::vector<std::vector<double> >& A,
+                               const std::vector<double>& b,
+                               const std::vector<double>& c) {
+  int m = b.size();
+  int n = c.size();
+  int w = n + m + 1;
+
+  // rows 0..m-1 hold the constraints with their slacks and row m the
+  // objective; the last column is the right hand side
+  std::vector<double> t((m + 1) * w, 0);
+  std::vector<int> basis(m);
+  for (int i = 0; i < m; i++) {
+    for (int j = 0; j < n; j++) {
+      t[i * w + j] = A[i][j];
+    }
+    t[i * w + n + i] = 1;
+    t[i * w + w - 1] = b[i];
+    basis[i] = n + i;
+  }
+  for (int j = 0; j < n; j++) {
+    t[m * w + j] = -c[j];
+  }
+
+  int max_iter = 50 * (n + m);
+  for (int iter = 0; iter < max_iter; iter++) {
+    int col = -1;
+    for (int j = 0; j < n + m && col < 0; j++) {
+      if (t[m * w + j] < -kLPEps) {
+        col = j;
+      }
+    }
+    if (col < 0) {
+      break;  // optimal
+    }
+
+    int row = -1;
+    double best = 0;
+    for (int i = 0; i < m; i++) {
+      double a = t[i * w + col];
+      if (a <= kLPEps) {
+        continue;
+      }
+      double r = t[i * w + w - 1] / a;
+      if (row < 0 || r < best - kLPEps ||
+          (r <= best + kLPEps && basis[i] < basis[row])) {
+        row = i;
+        best = r;
+      }
+    }
+    if (row < 0) {
+      break;  // unbounded, keep the current vertex
+    }
+
+    double p = t[row * w + col];
+    for (int j = 0; j < w; j++) {
+      t[row * w + j] /= p;
+    }
+    for (int i = 0; i <= m; i++) {
+      double f = t[i * w + col];
+      if (i == row || f == 0) {
+        continue;
+      }
+      for (int j = 0; j < w; j++) {
+        t[i * w + j] -= f * t[row * w + j];
+      }
+    }
+    basis[row] = col;
+  }
+
+  std::vector<double> x(n, 0);
+  for (int i = 0; i < m; i++) {
+    if (basis[i] < n) {
+      x[basis[i]] = std::max(0.0, t[i * w + w - 1]);
+    }
+  }
+  return x;
+}
+
+// Returns true if nuc is, or is an isotope of, the target nuclide or element.
+bool MatchesTarget(int nuc, int target) {
+  if (target % 10000000 == 0) {
+    return nuc / 10000000 == target / 10000000;
+  }
+  return nuc == target;
+}
+
+}  // namespace
+
+std::vector<double> BlendQuantities(
+    const std::vector<std::vector<double> >& fracs,
+    const std::vector<double>& lo, const std::vector<double>& hi,
+    const std::vector<double>& avail, double cap) {
+  int n = avail.size();
+  int k = lo.size();
+
+  // lo[j] * sum(q) <= sum(fracs[i][j] * q[i]) <= hi[j] * sum(q), written as
+  // two rows each with a zero right hand side
+  std::vector<std::vector<double> > A;
+  std::vector<double> b;
+  for (int j = 0; j < k; j++) {
+    std::vector<double> upper(n);
+    std::vector<double> lower(n);
+    for (int i = 0; i < n; i++) {
+      upper[i] = fracs[i][j] - hi[j];
+      lower[i] = lo[j] - fracs[i][j];
+    }
+    A.push_back(upper);
+    b.push_back(0);
+    A.push_back(lower);
+    b.push_back(0);
+  }
+  for (int i = 0; i < n; i++) {
+    std::vector<double> row(n, 0);
+    row[i] = 1;
+    A.push_back(row);
+    b.push_back(std::max(0.0, avail[i]));
+  }
+  A.push_back(std::vector<double>(n, 1));
+  b.push_back(std::max(0.0, cap));
+
+  return MaximizeLP(A, b, std::vector<double>(n, 1));
+}
+
 Mixer::Mixer(cyclus::Context* ctx)
     : cyclus::Facility(ctx),
       throughput(0) {
@@ -20,11 +152,10 @@ cyclus::Inventories Mixer::SnapshotInv() {
   invs["output-inv-name"] = output.PopNRes(output.count());
   output.Push(invs["output-inv-name"]);
 
-  std::map<std::string, cyclus::toolkit::ResBuf<cyclus::Material> >::iterator
-      it;
-  for (it = streambufs.begin(); it != streambufs.end(); ++it) {
-    invs[it->first] = it->second.PopNRes(it->second.count());
-    it->second.Push(invs[it->first]);
+  for (int i = 0; i < streambufs.size(); i++) {
+    std::string name = StreamName_(i);
+    invs[name] = streambufs[i].PopNRes(streambufs[i].count());
+    streambufs[i].Push(invs[name]);
   }
   return invs;
 }
@@ -33,9 +164,12 @@ void Mixer::InitInv(cyclus::Inventories& inv) {
   inv["output-inv-name"] = output.PopNRes(output.count());
   output.Push(inv["output-inv-name"]);
 
-  cyclus::Inventories::iterator it;
-  for (it = inv.begin(); it != inv.end(); ++it) {
-    streambufs[it->first].Push(it->second);
+  streambufs.resize(streams_.size());
+  for (int i = 0; i < streambufs.size(); i++) {
+    cyclus::Inventories::iterator it = inv.find(StreamName_(i));
+    if (it != inv.end()) {
+      streambufs[i].Push(it->second);
+    }
   }
 }
 
@@ -47,14 +181,14 @@ void Mixer::EnterNotify() {
   in_commods.clear();
 
   // initialisation internal variable
+  streambufs.resize(streams_.size());
   for (int i = 0; i < streams_.size(); i++) {
     mixing_ratios.push_back(streams_[i].first.first);
     in_buf_sizes.push_back(streams_[i].first.second);
 
-    std::string name = "in_stream_" + std::to_string(i);
     double cap = in_buf_sizes[i];
     if (cap >= 0) {
-      streambufs[name].capacity(cap);
+      streambufs[i].capacity(cap);
     }
     in_commods.push_back(streams_[i].second);
 
@@ -90,17 +224,38 @@ void Mixer::EnterNotify() {
     }
   }
 
+  if (target_min_fracs.size() != target_nucs.size() ||
+      target_max_fracs.size() != target_nucs.size()) {
+    std::stringstream ss;
+    ss << "prototype '" << prototype() << "' has "
+       << target_min_fracs.size() << " target minimum fractions and "
+       << target_max_fracs.size() << " target maximum fractions, expected "
+       << target_nucs.size();
+    throw cyclus::ValidationError(ss.str());
+  }
+  for (int j = 0; j < target_nucs.size(); j++) {
+    double lo = target_min_fracs[j];
+    double hi = target_max_fracs[j];
+    if (lo < 0 || hi > 1 || lo > hi) {
+      std::stringstream ss;
+      ss << "prototype '" << prototype() << "': target fractions ["
+         << lo << ", " << hi << "] of " << target_nucs[j]
+         << " must satisfy 0 <= min <= max <= 1";
+      throw cyclus::ValidationError(ss.str());
+    }
+  }
+
   sell_policy.Init(this, &output, "output").Set(out_commod).Start();
 }
 
 void Mixer::Tick() {
-  if (output.quantity() < output.capacity()) {
+  if (target_nucs.size() > 0) {
+    MixToTarget_();
+  } else if (output.quantity() < output.capacity()) {
     double tgt_qty = output.space();
 
     for (int i = 0; i < mixing_ratios.size(); i++) {
-      std::string name = "in_stream_" + std::to_string(i);
-      tgt_qty =
-          std::min(tgt_qty, streambufs[name].quantity() / mixing_ratios[i]);
+      tgt_qty = std::min(tgt_qty, streambufs[i].quantity() / mixing_ratios[i]);
     }
 
     tgt_qty = std::min(tgt_qty, throughput);
@@ -108,13 +263,12 @@ void Mixer::Tick() {
     if (tgt_qty > 0) {
       cyclus::Material::Ptr m;
       for (int i = 0; i < mixing_ratios.size(); i++) {
-        std::string name = "in_stream_" + std::to_string(i);
         double pop_qty = mixing_ratios[i] * tgt_qty;
         if (i == 0) {
-          m = streambufs[name].Pop(pop_qty, cyclus::eps_rsrc());
+          m = streambufs[i].Pop(pop_qty, cyclus::eps_rsrc());
         } else {
           cyclus::Material::Ptr m_ =
-              streambufs[name].Pop(pop_qty, cyclus::eps_rsrc());
+              streambufs[i].Pop(pop_qty, cyclus::eps_rsrc());
           m->Absorb(m_);
         }
       }
@@ -124,34 +278,87 @@ void Mixer::Tick() {
   cyclus::toolkit::RecordTimeSeries<double>("supply"+out_commod, this, output.quantity());
 }
 
+void Mixer::MixToTarget_() {
+  double cap = std::min(output.space(), throughput);
+  if (cap <= cyclus::eps_rsrc()) {
+    return;
+  }
+
+  int n = streambufs.size();
+  std::vector<std::vector<double> > fracs(
+      n, std::vector<double>(target_nucs.size(), 0));
+  std::vector<double> avail(n, 0);
+  for (int i = 0; i < n; i++) {
+    if (streambufs[i].count() == 0) {
+      continue;
+    }
+    // merge each stream into one material so that whatever is drawn from it
+    // has the composition the blend was solved for
+    cyclus::Material::Ptr m = cyclus::toolkit::Squash(
+        streambufs[i].PopN(streambufs[i].count()));
+    streambufs[i].Push(m);
+    avail[i] = m->quantity();
+
+    const cyclus::CompMap& comp = m->comp()->mass();
+    cyclus::CompMap::const_iterator it;
+    double total = 0;
+    for (it = comp.begin(); it != comp.end(); ++it) {
+      total += it->second;
+    }
+    for (it = comp.begin(); it != comp.end() && total > 0; ++it) {
+      for (int j = 0; j < target_nucs.size(); j++) {
+        if (MatchesTarget(it->first, target_nucs[j])) {
+          fracs[i][j] += it->second / total;
+        }
+      }
+    }
+  }
+
+  std::vector<double> qtys = BlendQuantities(fracs, target_min_fracs,
+                                             target_max_fracs, avail, cap);
+  cyclus::Material::Ptr m;
+  for (int i = 0; i < n; i++) {
+    double pop_qty = std::min(qtys[i], streambufs[i].quantity());
+    if (pop_qty <= cyclus::eps_rsrc()) {
+      continue;
+    }
+    cyclus::Material::Ptr m_ = streambufs[i].Pop(pop_qty, cyclus::eps_rsrc());
+    if (!m) {
+      m = m_;
+    } else {
+      m->Absorb(m_);
+    }
+  }
+  if (m) {
+    output.Push(m);
+  }
+}
+
 std::set<cyclus::RequestPortfolio<cyclus::Material>::Ptr>
 Mixer::GetMatlRequests() {
   using cyclus::RequestPortfolio;
 
   for (int i = 0; i < mixing_ratios.size(); i++)
   {
-    std::string name = "in_stream_" + std::to_string(i);
     std::map<std::string, double>::iterator it;
     std::map<std::string, double>::iterator max_it = in_commods[i].begin();
     double prev_pref = 0;
     for (it = in_commods[i].begin(); it != in_commods[i].end(); it++)
     {
       cyclus::toolkit::RecordTimeSeries<double>("demand" + it->first, this,
-                                                streambufs[name].space());
+                                                streambufs[i].space());
     }
   }
 
   std::set<RequestPortfolio<cyclus::Material>::Ptr> ports;
 
   for (int i = 0; i < in_commods.size(); i++) {
-    std::string name = "in_stream_" + std::to_string(i);
-
-    if (streambufs[name].space() > cyclus::eps_rsrc()) {
+    if (streambufs[i].space() > cyclus::eps_rsrc()) {
       RequestPortfolio<cyclus::Material>::Ptr port(
           new RequestPortfolio<cyclus::Material>());
 
       cyclus::Material::Ptr m;
-      m = cyclus::NewBlankMaterial(streambufs[name].space());
+      m = cyclus::NewBlankMaterial(streambufs[i].space());
 
       std::vector<cyclus::Request<cyclus::Material>*> reqs;
 
@@ -160,7 +367,7 @@ Mixer::GetMatlRequests() {
         std::string commod = it->first;
         double pref = it->second;
         reqs.push_back(port->AddRequest(m, this, commod , pref, false));
-        req_inventories_[reqs.back()] = name;
+        req_inventories_[reqs.back()] = i;
       }
       port->AddMutualReqs(reqs);
       ports.insert(port);
@@ -179,21 +386,12 @@ void Mixer::AcceptMatlTrades(
     cyclus::Request<cyclus::Material>* req = trade->first.request;
     cyclus::Material::Ptr m = trade->second;
 
-    std::string name = req_inventories_[req];
-    bool assigned = false;
-    std::map<std::string, cyclus::toolkit::ResBuf<cyclus::Material> >::iterator
-        it;
-
-    for (it = streambufs.begin(); it != streambufs.end(); it++) {
-      if (name == it->first) {
-        it->second.Push(m);
-        assigned = true;
-        break;
-      }
-    }
-    if (!assigned) {
+    std::map<cyclus::Request<cyclus::Material>*, int>::iterator it =
+        req_inventories_.find(req);
+    if (it == req_inventories_.end()) {
       throw cyclus::ValueError("cycamore::Mixer was overmatched on requests");
     }
+    streambufs[it->second].Push(m);
   }
 
   req_inventories_.clear();
@@ -9,11 +9,27 @@
 
 namespace cycamore {
 
+/// Returns the mass to draw from each stream to make as much mixed material
+/// as possible, at most cap, such that the mass fraction of every target j in
+/// the mix lies within [lo[j], hi[j]]. fracs[i][j] is the mass fraction of
+/// target j in stream i and avail[i] the mass available in stream i. The
+/// result is all zeros if the window can't be met with the streams on hand.
+std::vector<double> BlendQuantities(
+    const std::vector<std::vector<double> >& fracs,
+    const std::vector<double>& lo, const std::vector<double>& hi,
+    const std::vector<double>& avail, double cap);
+
 /// Mixer mixes N streams with fixed, static, user-specified
 /// ratios into a single output stream. The Mixer has N input inventories:
 /// one for each streams to be mixed, and one output stream. The supplying of
 /// mixed material is constrained by available inventory of mixed material
 /// quantities.
+///
+/// If target_nucs is given, the mixing ratios are ignored and the Mixer
+/// instead solves every time step for the stream quantities that make the
+/// most material whose mass fraction of each target nuclide or element lies
+/// between its target_min_fracs and target_max_fracs values, using the
+/// current composition of each stream inventory (see BlendQuantities).
 class Mixer
   : public cyclus::Facility,
     public cyclus::toolkit::Position {
@@ -23,7 +39,10 @@ class Mixer
            " ratios into a single output stream. The Mixer has N input"\
            " inventories: one for each streams to be mixed, and one output"\
            " stream. The supplying of mixed material is constrained by "\
-           " available inventory of mixed material quantities.", \
+           " available inventory of mixed material quantities."\
+           " Alternatively, target mass fraction windows can be given for"\
+           " nuclides or elements, and the stream ratios are then solved"\
+           " for every time step from the stream compositions on hand.", \
     }
 
   friend class MixerTest;
@@ -73,8 +92,9 @@ class Mixer
   std::vector<double> mixing_ratios;
 
   // custom SnapshotInv and InitInv and EnterNotify are used to persist this
-  // state var.
-  std::map<std::string, cyclus::toolkit::ResBuf<cyclus::Material> > streambufs;
+  // state var. Buffers are indexed by stream; the "in_stream_<i>" names are
+  // only used for snapshots.
+  std::vector<cyclus::toolkit::ResBuf<cyclus::Material> > streambufs;
 
 
 #pragma cyclus var {                                                 \
@@ -107,9 +127,44 @@ class Mixer
   }
   double throughput;
 
+#pragma cyclus var { \
+    "default": [], \
+    "doc": "Nuclides or elements whose mass fraction in the mixed material" \
+           " must lie within a target window. If given, mixing ratios are" \
+           " ignored and the stream quantities are solved for every time" \
+           " step to make the most material within all windows.", \
+    "uilabel": "Target Nuclides", \
+    "uitype": ["oneormore", "nuclide"], \
+  }
+  std::vector<int> target_nucs;
+
+#pragma cyclus var { \
+    "default": [], \
+    "doc": "Minimum mass fraction of each target nuclide or element in the" \
+           " mixed material, in the same order as target_nucs.", \
+    "uilabel": "Target Minimum Fractions", \
+  }
+  std::vector<double> target_min_fracs;
+
+#pragma cyclus var { \
+    "default": [], \
+    "doc": "Maximum mass fraction of each target nuclide or element in the" \
+           " mixed material, in the same order as target_nucs.", \
+    "uilabel": "Target Maximum Fractions", \
+  }
+  std::vector<double> target_max_fracs;
+
   // intra-time-step state - no need to be a state var
-  // map<request, inventory name>
-  std::map<cyclus::Request<cyclus::Material>*, std::string> req_inventories_;
+  // map<request, stream index>
+  std::map<cyclus::Request<cyclus::Material>*, int> req_inventories_;
+
+  /// Mixes the streams to meet the target_nucs windows.
+  void MixToTarget_();
+
+  /// Returns the snapshot inventory name of stream i.
+  static std::string StreamName_(int i) {
+    return "in_stream_" + std::to_string(i);
+  }
 
   //// A policy for sending material
   cyclus::toolkit::MatlSellPolicy sell_policy;
@@ -146,10 +146,19 @@ class MixerTest : public ::testing::Test {
     mf_facility_->out_buf_size = cap;
   }
 
+  void SetTargets(std::vector<int> nucs, std::vector<double> mins,
+                  std::vector<double> maxs) {
+    mf_facility_->target_nucs = nucs;
+    mf_facility_->target_min_fracs = mins;
+    mf_facility_->target_max_fracs = maxs;
+  }
+
   void SetInputInv(std::vector<cyclus::Material::Ptr> mat) {
+    if (mf_facility_->streambufs.size() < mat.size()) {
+      mf_facility_->streambufs.resize(mat.size());
+    }
     for (int i = 0; i < mat.size(); i++) {
-      std::string name = "in_stream_" + std::to_string(i);
-      mf_facility_->streambufs[name].Push(mat[i]);
+      mf_facility_->streambufs[i].Push(mat[i]);
     }
   }
 
@@ -167,9 +176,23 @@ class MixerTest : public ::testing::Test {
 
   InvBuffer* GetOutPutBuffer() { return &mf_facility_->output; }
 
-  std::map<std::string, InvBuffer> GetStreamBuffer() {
+  std::vector<InvBuffer> GetStreamBuffer() {
     return mf_facility_->streambufs;
   }
+
+  // restores invs into a fresh Mixer with the same streams and returns the
+  // quantity held by each of its stream buffers
+  std::vector<double> RestoreStreamBuffer(cyclus::Inventories& invs) {
+    Mixer restored(tc_.get());
+    restored.streams_ = mf_facility_->streams_;
+    restored.InitInv(invs);
+
+    std::vector<double> qtys;
+    for (int i = 0; i < restored.streambufs.size(); i++) {
+      qtys.push_back(restored.streambufs[i].quantity());
+    }
+    return qtys;
+  }
 };
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
@@ -299,13 +322,12 @@ TEST_F(MixerTest, Throughput) {
     cap.push_back(in_cap[i] - 0.5 * in_frac[i]);
   }
 
-  std::map<std::string, InvBuffer> streambuf = GetStreamBuffer();
+  std::vector<InvBuffer> streambuf = GetStreamBuffer();
 
   for (int i = 0; i < in_coms.size(); i++) {
-    std::string name = "in_stream_" + std::to_string(i);
     double buf_size = in_cap[i];
     double buf_ratio = in_frac[i];
-    double buf_inv = streambuf[name].quantity();
+    double buf_inv = streambuf[i].quantity();
 
     // checking that each input buf was reduce of the correct amount
     // (constrained by the throughput"
@@ -320,6 +342,94 @@ TEST_F(MixerTest, Throughput) {
          "correctly constrained by throughput.";
 }
 
+// Check that stream inventories are snapshotted by name and restored to the
+// same stream index.
+TEST_F(MixerTest, SnapshotInv) {
+  using cyclus::Material;
+
+  std::vector<Material::Ptr> mat;
+  mat.push_back(Material::CreateUntracked(in_cap[0], c_natu()));
+  mat.push_back(Material::CreateUntracked(in_cap[1], c_pustream()));
+  mat.push_back(Material::CreateUntracked(in_cap[2], c_uox()));
+  SetInputInv(mat);
+
+  cyclus::Inventories invs = mf_facility_->SnapshotInv();
+  ASSERT_EQ(1, invs.count("in_stream_2"));
+
+  std::vector<double> qtys = RestoreStreamBuffer(invs);
+  ASSERT_EQ(in_cap.size(), qtys.size());
+  for (int i = 0; i < in_cap.size(); i++) {
+    EXPECT_DOUBLE_EQ(in_cap[i], qtys[i]);
+  }
+}
+
+// Check the stream quantities solved for a target fraction window.
+TEST(MixerTests, BlendQuantities) {
+  std::vector<std::vector<double> > fracs(2, std::vector<double>(1));
+  fracs[0][0] = 0;
+  fracs[1][0] = 0.1;
+  std::vector<double> lo(1, 0.05);
+  std::vector<double> hi(1, 0.06);
+  std::vector<double> avail(2, 100);
+
+  // all of both streams makes a 5% mix
+  std::vector<double> q = BlendQuantities(fracs, lo, hi, avail, 1000);
+  EXPECT_NEAR(100, q[0], 1e-9);
+  EXPECT_NEAR(100, q[1], 1e-9);
+
+  // with less of the lean stream the rich stream is held back to 6%
+  avail[0] = 50;
+  q = BlendQuantities(fracs, lo, hi, avail, 1000);
+  EXPECT_NEAR(50, q[0], 1e-9);
+  EXPECT_NEAR(75, q[1], 1e-9);
+
+  // limited by cap
+  q = BlendQuantities(fracs, lo, hi, avail, 40);
+  EXPECT_NEAR(40, q[0] + q[1], 1e-9);
+  EXPECT_LE(0.05 * 40 - 1e-9, 0.1 * q[1]);
+  EXPECT_GE(0.06 * 40 + 1e-9, 0.1 * q[1]);
+
+  // a window the streams can't reach makes nothing
+  lo[0] = 0.2;
+  hi[0] = 0.3;
+  q = BlendQuantities(fracs, lo, hi, avail, 1000);
+  EXPECT_DOUBLE_EQ(0, q[0]);
+  EXPECT_DOUBLE_EQ(0, q[1]);
+}
+
+// Check that mixing to a target Pu window makes the most material in the
+// window from the stream inventories.
+TEST_F(MixerTest, MixToTarget) {
+  using cyclus::Material;
+  using pyne::nucname::id;
+
+  SetOutStream_capacity(50);
+  SetThroughput(cyclus::CY_LARGE_DOUBLE);
+  SetTargets(std::vector<int>(1, id("Pu")), std::vector<double>(1, 0.05),
+             std::vector<double>(1, 0.06));
+
+  std::vector<Material::Ptr> mat;
+  mat.push_back(Material::CreateUntracked(in_cap[0], c_natu()));
+  mat.push_back(Material::CreateUntracked(in_cap[1], c_pustream()));
+  mat.push_back(Material::CreateUntracked(in_cap[2], c_uox()));
+  SetInputInv(mat);
+  mf_facility_->Tick();
+
+  // the 40 kg of uranium streams can take at most 6% Pu
+  double want = (in_cap[0] + in_cap[2]) / 0.94;
+  InvBuffer* buffer = GetOutPutBuffer();
+  EXPECT_NEAR(want, buffer->quantity(), 1e-6);
+
+  Material::Ptr final_mat = cyclus::ResCast<Material>(buffer->PopBack());
+  cyclus::toolkit::MatQuery mq(final_mat);
+  double pu = mq.mass(id("Pu239")) + mq.mass(id("Pu240")) +
+              mq.mass(id("Pu241")) + mq.mass(id("Pu242"));
+  EXPECT_NEAR(0.06, pu / final_mat->quantity(), 1e-9);
+
+  std::vector<InvBuffer> streambuf = GetStreamBuffer();
+  EXPECT_NEAR(in_cap[1] - 0.06 * want, streambuf[1].quantity(), 1e-6);
+}
+
 // multiple input streams can be correctly requested and used as
 //  material inventory.
 TEST(MixerTests, MultipleFissStreams) {
@@ -1,5 +1,7 @@
 #include "reactor.h"
 
+#include <algorithm>
+
 using cyclus::Material;
 using cyclus::toolkit::MatVec;
 using cyclus::KeyError;
@@ -8,6 +10,252 @@ using cyclus::Request;
 
 namespace cycamore {
 
+// the table is kept between 1/8 and 1/2 full - with a lower limit on the
+// allocation size to prevent thrashing on small cores.
+static const int kMinIndexCapacity = 16;
+
+AssemblyIndex::AssemblyIndex() : size_(0), shift_(32) {}
+
+int AssemblyIndex::Home(int obj_id) const {
+  // fibonacci hashing - the high bits of the product depend on all bits of
+  // the id, so ids with power of two strides still spread across the table.
+  unsigned int h = static_cast<unsigned int>(obj_id) * 2654435769u;
+  return static_cast<int>(h >> shift_);
+}
+
+int AssemblyIndex::MaxProbe() const {
+  int mask = entries_.size() - 1;
+  int longest = 0;
+  for (int i = 0; i < entries_.size(); i++) {
+    if (entries_[i].obj_id != -1) {
+      longest = std::max(longest, ((i - Home(entries_[i].obj_id)) & mask) + 1);
+    }
+  }
+  return longest;
+}
+
+int AssemblyIndex::Find(int obj_id) const {
+  if (entries_.empty()) {
+    return -1;
+  }
+  int mask = entries_.size() - 1;
+  for (int i = Home(obj_id); entries_[i].obj_id != -1; i = (i + 1) & mask) {
+    if (entries_[i].obj_id == obj_id) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+int AssemblyIndex::Get(int obj_id) const {
+  int i = Find(obj_id);
+  return i < 0 ? -1 : entries_[i].fuel_index;
+}
+
+void AssemblyIndex::Set(int obj_id, int fuel_index) {
+  int i = Find(obj_id);
+  if (i >= 0) {
+    entries_[i].fuel_index = fuel_index;
+    return;
+  }
+
+  if (2 * (size_ + 1) > capacity()) {
+    Resize(std::max(kMinIndexCapacity, 2 * capacity()));
+  }
+  int mask = entries_.size() - 1;
+  for (i = Home(obj_id); entries_[i].obj_id != -1; i = (i + 1) & mask) {}
+  entries_[i].obj_id = obj_id;
+  entries_[i].fuel_index = fuel_index;
+  size_++;
+}
+
+bool AssemblyIndex::Erase(int obj_id) {
+  int i = Find(obj_id);
+  if (i < 0) {
+    return false;
+  }
+
+  // backward shift deletion - move later entries of the probe chain into the
+  // hole so no tombstones are needed.
+  int mask = entries_.size() - 1;
+  int j = i;
+  while (true) {
+    j = (j + 1) & mask;
+    if (entries_[j].obj_id == -1) {
+      break;
+    }
+    int home = Home(entries_[j].obj_id);
+    bool movable = (i <= j) ? (home <= i || home > j) : (home <= i && home > j);
+    if (movable) {
+      entries_[i] = entries_[j];
+      i = j;
+    }
+  }
+  entries_[i].obj_id = -1;
+  size_--;
+
+  if (size_ == 0) {
+    Clear();
+  } else if (8 * size_ < capacity() && capacity() > kMinIndexCapacity) {
+    Resize(capacity() / 2);
+  }
+  return true;
+}
+
+void AssemblyIndex::Clear() {
+  std::vector<Entry>().swap(entries_);
+  size_ = 0;
+  shift_ = 32;
+}
+
+void AssemblyIndex::Resize(int n) {
+  std::vector<Entry> old;
+  old.swap(entries_);
+  Entry empty = {-1, -1};
+  entries_.assign(n, empty);
+  size_ = 0;
+  // n is a power of two - Home keeps the top log2(n) bits of the hash
+  shift_ = 32;
+  for (int m = n; m > 1; m >>= 1) {
+    shift_--;
+  }
+  for (int i = 0; i < old.size(); i++) {
+    if (old[i].obj_id != -1) {
+      Set(old[i].obj_id, old[i].fuel_index);
+    }
+  }
+}
+
+std::map<int, int> AssemblyIndex::ToMap() const {
+  std::map<int, int> m;
+  for (int i = 0; i < entries_.size(); i++) {
+    if (entries_[i].obj_id != -1) {
+      m[entries_[i].obj_id] = entries_[i].fuel_index;
+    }
+  }
+  return m;
+}
+
+void CheckFuelSpecs(const std::string& prototype,
+                    const std::vector<std::string>& incommods,
+                    const std::vector<std::string>& inrecipes,
+                    const std::vector<std::string>& outcommods,
+                    const std::vector<std::string>& outrecipes,
+                    const std::vector<double>& prefs,
+                    std::stringstream& ss) {
+  int n = incommods.size();
+  if (inrecipes.size() != n) {
+    ss << "prototype '" << prototype << "' has " << inrecipes.size()
+       << " fuel_inrecipes vals, expected " << n << "\n";
+  }
+  if (outrecipes.size() != n) {
+    ss << "prototype '" << prototype << "' has " << outrecipes.size()
+       << " fuel_outrecipes vals, expected " << n << "\n";
+  }
+  if (outcommods.size() != n) {
+    ss << "prototype '" << prototype << "' has " << outcommods.size()
+       << " fuel_outcommods vals, expected " << n << "\n";
+  }
+  if (prefs.size() != n) {
+    ss << "prototype '" << prototype << "' has " << prefs.size()
+       << " fuel_prefs vals, expected " << n << "\n";
+  }
+}
+
+std::vector<FuelSlot> MakeFuelSlots(cyclus::Context* ctx,
+                                    const std::vector<std::string>& incommods,
+                                    const std::vector<std::string>& inrecipes,
+                                    const std::vector<std::string>& outcommods,
+                                    const std::vector<std::string>& outrecipes,
+                                    const std::vector<double>& prefs) {
+  std::vector<FuelSlot> slots;
+  for (int i = 0; i < incommods.size(); i++) {
+    FuelSlot slot;
+    slot.incommod = incommods[i];
+    slot.outcommod = outcommods[i];
+    slot.pref = i < prefs.size() ? prefs[i] : cyclus::kDefaultPref;
+    slot.inrecipe_name = inrecipes[i];
+    slot.outrecipe_name = outrecipes[i];
+    slot.inrecipe = ctx->GetRecipe(slot.inrecipe_name);
+    slot.outrecipe = ctx->GetRecipe(slot.outrecipe_name);
+    slots.push_back(slot);
+  }
+  return slots;
+}
+
+CoreCycle::CoreCycle(int cycle_time, int refuel_time, int n_assem_core,
+                     int n_assem_batch, int n_assem_fresh)
+    : cycle_time_(cycle_time),
+      refuel_time_(refuel_time),
+      n_assem_core_(n_assem_core),
+      n_assem_batch_(n_assem_batch),
+      n_assem_fresh_(n_assem_fresh) {}
+
+bool CoreCycle::Restarts(int cycle_step, int n_core, bool discharged) const {
+  return cycle_step >= cycle_time_ + refuel_time_ &&
+         n_core == n_assem_core_ && discharged;
+}
+
+bool CoreCycle::Starts(int cycle_step, int n_core) const {
+  return cycle_step == 0 && n_core == n_assem_core_;
+}
+
+bool CoreCycle::Operating(int cycle_step, int n_core) const {
+  return cycle_step >= 0 && cycle_step < cycle_time_ &&
+         n_core == n_assem_core_;
+}
+
+int CoreCycle::Advance(int cycle_step, int n_core) const {
+  // prevents starting the cycle after initial deployment until the core is
+  // full even though cycle_step is its initial zero.
+  if (cycle_step > 0 || n_core == n_assem_core_) {
+    return cycle_step + 1;
+  }
+  return cycle_step;
+}
+
+int CoreCycle::NDischarge(int n_core) const {
+  return std::min(n_assem_batch_, n_core);
+}
+
+int CoreCycle::NDecomTransmute(bool all) const {
+  if (all) {
+    return n_assem_core_;
+  }
+  return static_cast<int>(ceil(static_cast<double>(n_assem_core_) / 2.0));
+}
+
+int CoreCycle::NOrder(int cycle_step, int n_core, int n_fresh, int exit_time,
+                      int time) const {
+  int n = n_assem_core_ - n_core + n_assem_fresh_ - n_fresh;
+  if (exit_time != -1) {
+    // the +1 accounts for the fact that the core is alive and gets to
+    // operate during its exit_time time step.
+    int t_left = exit_time - time + 1;
+    int t_left_cycle = cycle_time_ + refuel_time_ - cycle_step;
+    double n_cycles_left = static_cast<double>(t_left - t_left_cycle) /
+                           static_cast<double>(cycle_time_ + refuel_time_);
+    n_cycles_left = ceil(n_cycles_left);
+    int n_need = std::max(0.0, n_cycles_left * n_assem_batch_ -
+                                   n_assem_fresh_ + n_assem_core_ - n_core);
+    n = std::min(n, n_need);
+  }
+  return n;
+}
+
+namespace {
+
+bool CompareBurnupTimes(const std::pair<int, cyclus::Composition::Ptr>& a,
+                        const std::pair<int, cyclus::Composition::Ptr>& b) {
+  return a.first < b.first;
+}
+
+bool CompareFuelChangeTimes(const FuelChange& a, const FuelChange& b) {
+  return a.time < b.time;
+}
+
+}  // namespace
+
 Reactor::Reactor(cyclus::Context* ctx)
     : cyclus::Facility(ctx),
       n_assem_batch(0),
@@ -21,7 +269,15 @@ Reactor::Reactor(cyclus::Context* ctx)
       power_cap(0),
       power_name("power"),
       discharged(false),
-      keep_packaging(true) {}
+      keep_packaging(true),
+      batch_requests(false),
+      aggregate_bids(false),
+      record_intervals(false),
+      expand_intervals(false),
+      legacy_events(true),
+      op_steps(0),
+      n_spent_(0),
+      next_fuel_change_(0) {}
 
 
 #pragma cyclus def clone cycamore::Reactor
@@ -32,20 +288,75 @@ Reactor::Reactor(cyclus::Context* ctx)
 
 #pragma cyclus def infiletodb cycamore::Reactor
 
-#pragma cyclus def snapshot cycamore::Reactor
+void Reactor::Snapshot(cyclus::DbInit di) {
+  // res_indexes is only populated while it is being persisted.
+  res_indexes = assem_index_.ToMap();
+  #pragma cyclus impl snapshot cycamore::Reactor
+  res_indexes.clear();
+}
+
+// the snapshotinv and initinv pragmas are ommitted and the functions are
+// written manually in order to handle the per-outcommod spent fuel inventory.
+cyclus::Inventories Reactor::SnapshotInv() {
+  cyclus::Inventories invs;
+  invs["fresh"] = fresh.PopNRes(fresh.count());
+  fresh.Push(invs["fresh"]);
+  invs["core"] = core.PopNRes(core.count());
+  core.Push(invs["core"]);
+
+  std::vector<cyclus::Resource::Ptr>& spentinv = invs["spent"];
+  std::map<std::string, std::deque<Material::Ptr> >::iterator it;
+  for (it = spent.begin(); it != spent.end(); ++it) {
+    spentinv.insert(spentinv.end(), it->second.begin(), it->second.end());
+  }
+  return invs;
+}
+
+void Reactor::InitInv(cyclus::Inventories& inv) {
+  // restoring the spent inventory needs each assembly's outcommod, and
+  // InitInv runs before EnterNotify.
+  BuildFuelSlots();
+
+  // drop index entries for any assemblies that are no longer held.
+  AssemblyIndex held;
+  cyclus::Inventories::iterator it;
+  for (it = inv.begin(); it != inv.end(); ++it) {
+    for (int i = 0; i < it->second.size(); i++) {
+      int obj_id = it->second[i]->obj_id();
+      int index = assem_index_.Get(obj_id);
+      if (index >= 0) {
+        held.Set(obj_id, index);
+      }
+    }
+  }
+  assem_index_ = held;
 
-#pragma cyclus def snapshotinv cycamore::Reactor
+  fresh.Push(inv["fresh"]);
+  core.Push(inv["core"]);
 
-#pragma cyclus def initinv cycamore::Reactor
+  std::vector<cyclus::Resource::Ptr>& spentinv = inv["spent"];
+  MatVec mats;
+  for (int i = 0; i < spentinv.size(); i++) {
+    mats.push_back(cyclus::ResCast<Material>(spentinv[i]));
+  }
+  PushSpent(mats);
+}
 
 void Reactor::InitFrom(Reactor* m) {
   #pragma cyclus impl initfromcopy cycamore::Reactor
   cyclus::toolkit::CommodityProducer::Copy(m);
+  assem_index_ = m->assem_index_;
 }
 
 void Reactor::InitFrom(cyclus::QueryableBackend* b) {
   #pragma cyclus impl initfromdb cycamore::Reactor
 
+  std::map<int, int>::iterator it;
+  for (it = res_indexes.begin(); it != res_indexes.end(); ++it) {
+    assem_index_.Set(it->first, it->second);
+  }
+  res_indexes.clear();
+
   namespace tk = cyclus::toolkit;
   tk::CommodityProducer::Add(tk::Commodity(power_name),
                              tk::CommodInfo(power_cap, power_cap));
@@ -63,7 +374,6 @@ void Reactor::EnterNotify() {
   // Set keep packaging parameter in all ResBufs
   fresh.keep_packaging(keep_packaging);
   core.keep_packaging(keep_packaging);
-  spent.keep_packaging(keep_packaging);
 
   // If the user ommitted fuel_prefs, we set it to zeros for each fuel
   // type.  Without this segfaults could occur - yuck.
@@ -79,8 +389,11 @@ void Reactor::EnterNotify() {
   }
 
   // input consistency checking:
-  int n = recipe_change_times.size();
   std::stringstream ss;
+  CheckFuelSpecs(prototype(), fuel_incommods, fuel_inrecipes, fuel_outcommods,
+                 fuel_outrecipes, fuel_prefs, ss);
+
+  int n = recipe_change_times.size();
   if (recipe_change_commods.size() != n) {
     ss << "prototype '" << prototype() << "' has "
        << recipe_change_commods.size()
@@ -95,6 +408,23 @@ void Reactor::EnterNotify() {
        << " recipe_change_out vals, expected " << n << "\n";
   }
 
+  n = burnup_commods.size();
+  if (burnup_times.size() != n) {
+    ss << "prototype '" << prototype() << "' has " << burnup_times.size()
+       << " burnup_times vals, expected " << n << "\n";
+  }
+  if (burnup_recipes.size() != n) {
+    ss << "prototype '" << prototype() << "' has " << burnup_recipes.size()
+       << " burnup_recipes vals, expected " << n << "\n";
+  }
+  for (int i = 0; i < burnup_commods.size(); i++) {
+    if (std::find(fuel_incommods.begin(), fuel_incommods.end(),
+                  burnup_commods[i]) == fuel_incommods.end()) {
+      ss << "prototype '" << prototype() << "' has burnup_commods val '"
+         << burnup_commods[i] << "' that is not in fuel_incommods\n";
+    }
+  }
+
   n = pref_change_times.size();
   if (pref_change_commods.size() != n) {
     ss << "prototype '" << prototype() << "' has " << pref_change_commods.size()
@@ -108,12 +438,107 @@ void Reactor::EnterNotify() {
   if (ss.str().size() > 0) {
     throw ValueError(ss.str());
   }
-  
+
+  BuildFuelSlots();
+  ScheduleFuelChanges();
+  if (interval_starts.size() != side_products.size() + 1) {
+    interval_starts.assign(side_products.size() + 1, -1);
+    interval_ends.assign(side_products.size() + 1, -1);
+    interval_values.assign(side_products.size() + 1, 0);
+  }
+
   InitializePosition();
 }
 
+void Reactor::BuildFuelSlots() {
+  // fuel_prefs is only defaulted in EnterNotify
+  fuel_slots_ = MakeFuelSlots(context(), fuel_incommods, fuel_inrecipes,
+                              fuel_outcommods, fuel_outrecipes, fuel_prefs);
+  for (int i = 0; i < fuel_slots_.size(); i++) {
+    FuelSlot& slot = fuel_slots_[i];
+    for (int j = 0; j < burnup_commods.size(); j++) {
+      if (burnup_commods[j] == slot.incommod) {
+        slot.burnup.push_back(std::make_pair(
+            burnup_times[j], context()->GetRecipe(burnup_recipes[j])));
+      }
+    }
+    std::stable_sort(slot.burnup.begin(), slot.burnup.end(),
+                     CompareBurnupTimes);
+  }
+  burnup_comps_.clear();
+}
+
+void Reactor::ScheduleFuelChanges() {
+  fuel_changes_.clear();
+  next_fuel_change_ = 0;
+
+  // changes for commodities the reactor doesn't request are ignored.
+  for (int i = 0; i < pref_change_times.size(); i++) {
+    for (int j = 0; j < fuel_incommods.size(); j++) {
+      if (fuel_incommods[j] == pref_change_commods[i]) {
+        FuelChange c = {pref_change_times[i], j, i, false};
+        fuel_changes_.push_back(c);
+        break;
+      }
+    }
+  }
+  for (int i = 0; i < recipe_change_times.size(); i++) {
+    for (int j = 0; j < fuel_incommods.size(); j++) {
+      if (fuel_incommods[j] == recipe_change_commods[i]) {
+        FuelChange c = {recipe_change_times[i], j, i, true};
+        fuel_changes_.push_back(c);
+        break;
+      }
+    }
+  }
+
+  // stable so that changes on the same time step are applied in the order
+  // they were specified.
+  std::stable_sort(fuel_changes_.begin(), fuel_changes_.end(),
+                   CompareFuelChangeTimes);
+}
+
+void Reactor::ApplyFuelChange(const FuelChange& c) {
+  int j = c.fuel_index;
+  if (c.recipe) {
+    fuel_inrecipes[j] = recipe_change_in[c.change_index];
+    fuel_outrecipes[j] = recipe_change_out[c.change_index];
+    fuel_slots_[j].inrecipe_name = fuel_inrecipes[j];
+    fuel_slots_[j].outrecipe_name = fuel_outrecipes[j];
+    fuel_slots_[j].inrecipe = context()->GetRecipe(fuel_inrecipes[j]);
+    fuel_slots_[j].outrecipe = context()->GetRecipe(fuel_outrecipes[j]);
+  } else {
+    fuel_prefs[j] = pref_change_values[c.change_index];
+    fuel_slots_[j].pref = fuel_prefs[j];
+  }
+}
+
+int Reactor::NextFuelChangeTime() const {
+  int t = context()->time();
+  for (int i = next_fuel_change_; i < fuel_changes_.size(); i++) {
+    if (fuel_changes_[i].time >= t) {
+      return fuel_changes_[i].time;
+    }
+  }
+  return -1;
+}
+
+void Reactor::SkipPastFuelChanges() {
+  int t = context()->time();
+  while (next_fuel_change_ < fuel_changes_.size() &&
+         fuel_changes_[next_fuel_change_].time < t) {
+    next_fuel_change_++;
+  }
+}
+
 bool Reactor::CheckDecommissionCondition() {
-  return core.count() == 0 && spent.count() == 0;
+  return core.count() == 0 && n_spent_ == 0;
+}
+
+void Reactor::Decommission() {
+  CloseIntervals();
+  assem_index_.Clear();
+  cyclus::Facility::Decommission();
 }
 
 void Reactor::Tick() {
@@ -125,15 +550,10 @@ void Reactor::Tick() {
   // chance to occur after the discharge on this same time step.
 
   if (retired()) {
-    Record("RETIRED", "");
+    Record(kEventRetired);
 
     if (context()->time() == exit_time() + 1) { // only need to transmute once
-      if (decom_transmute_all == true) {
-        Transmute(ceil(static_cast<double>(n_assem_core)));
-      }
-      else {
-        Transmute(ceil(static_cast<double>(n_assem_core) / 2.0));
-      }
+      Transmute(core_cycle().NDecomTransmute(decom_transmute_all));
     }
     while (core.count() > 0) {
       if (!Discharge()) {
@@ -143,8 +563,8 @@ void Reactor::Tick() {
     // in case a cycle lands exactly on our last time step, we will need to
     // burn a batch from fresh inventory on this time step.  When retired,
     // this batch also needs to be discharged to spent fuel inventory.
-    while (fresh.count() > 0 && spent.space() >= assem_size) {
-      spent.Push(fresh.Pop());
+    while (fresh.count() > 0 && n_spent_ < n_assem_spent) {
+      PushSpent(MatVec(1, fresh.Pop()));
     }
     if(CheckDecommissionCondition()) {
       context()->SchedDecom(this);    
@@ -152,51 +572,26 @@ void Reactor::Tick() {
     return;
   }
 
-  if (cycle_step == cycle_time) {
+  CoreCycle cc = core_cycle();
+  if (cc.Ends(cycle_step)) {
     Transmute();
-    Record("CYCLE_END", "");
+    Record(kEventCycleEnd);
   }
 
-  if (cycle_step >= cycle_time && !discharged) {
+  if (cc.Refueling(cycle_step) && !discharged) {
     discharged = Discharge();
   }
-  if (cycle_step >= cycle_time) {
+  if (cc.Refueling(cycle_step)) {
     Load();
   }
 
+  // update preferences and recipes - changes scheduled for past time steps
+  // (e.g. before the reactor was deployed) are skipped.
   int t = context()->time();
-
-  // update preferences
-  for (int i = 0; i < pref_change_times.size(); i++) {
-    int change_t = pref_change_times[i];
-    if (t != change_t) {
-      continue;
-    }
-
-    std::string incommod = pref_change_commods[i];
-    for (int j = 0; j < fuel_incommods.size(); j++) {
-      if (fuel_incommods[j] == incommod) {
-        fuel_prefs[j] = pref_change_values[i];
-        break;
-      }
-    }
-  }
-
-  // update recipes
-  for (int i = 0; i < recipe_change_times.size(); i++) {
-    int change_t = recipe_change_times[i];
-    if (t != change_t) {
-      continue;
-    }
-
-    std::string incommod = recipe_change_commods[i];
-    for (int j = 0; j < fuel_incommods.size(); j++) {
-      if (fuel_incommods[j] == incommod) {
-        fuel_inrecipes[j] = recipe_change_in[i];
-        fuel_outrecipes[j] = recipe_change_out[i];
-        break;
-      }
-    }
+  SkipPastFuelChanges();
+  while (NextFuelChangeTime() == t) {
+    ApplyFuelChange(fuel_changes_[next_fuel_change_]);
+    next_fuel_change_++;
   }
 }
 
@@ -206,21 +601,10 @@ std::set<cyclus::RequestPortfolio<Material>::Ptr> Reactor::GetMatlRequests() {
   std::set<RequestPortfolio<Material>::Ptr> ports;
   Material::Ptr m;
 
-  // second min expression reduces assembles to amount needed until
-  // retirement if it is near.
-  int n_assem_order = n_assem_core - core.count() + n_assem_fresh - fresh.count();
-
-  if (exit_time() != -1) {
-    // the +1 accounts for the fact that the reactor is alive and gets to
-    // operate during its exit_time time step.
-    int t_left = exit_time() - context()->time() + 1;
-    int t_left_cycle = cycle_time + refuel_time - cycle_step;
-    double n_cycles_left = static_cast<double>(t_left - t_left_cycle) /
-                         static_cast<double>(cycle_time + refuel_time);
-    n_cycles_left = ceil(n_cycles_left);
-    int n_need = std::max(0.0, n_cycles_left * n_assem_batch - n_assem_fresh + n_assem_core - core.count());
-    n_assem_order = std::min(n_assem_order, n_need);
-  }
+  // reduces assemblies to the amount needed until retirement if it is near.
+  int n_assem_order = core_cycle().NOrder(cycle_step, core.count(),
+                                          fresh.count(), exit_time(),
+                                          context()->time());
 
   if (n_assem_order == 0) {
     return ports;
@@ -228,24 +612,47 @@ std::set<cyclus::RequestPortfolio<Material>::Ptr> Reactor::GetMatlRequests() {
     return ports;
   }
 
+  if (batch_requests) {
+    // a single portfolio covers the whole order - each commodity is requested
+    // as one exclusive lump so it is either filled completely or not at all.
+    double qty = n_assem_order * assem_size;
+    RequestPortfolio<Material>::Ptr port(new RequestPortfolio<Material>());
+    std::vector<Request<Material>*> mreqs;
+    int max_index = 0;
+    for (int j = 0; j < fuel_slots_.size(); j++) {
+      const FuelSlot& slot = fuel_slots_[j];
+      m = Material::CreateUntracked(qty, slot.inrecipe);
+      mreqs.push_back(port->AddRequest(m, this, slot.incommod, slot.pref, true));
+      if (slot.pref > fuel_slots_[max_index].pref) {
+        max_index = j;
+      }
+    }
+
+    cyclus::toolkit::RecordTimeSeries<double>(
+        "demand"+fuel_slots_[max_index].incommod, this, qty);
+
+    port->AddMutualReqs(mreqs);
+    ports.insert(port);
+    return ports;
+  }
+
   for (int i = 0; i < n_assem_order; i++) {
     RequestPortfolio<Material>::Ptr port(new RequestPortfolio<Material>());
     std::vector<Request<Material>*> mreqs;
-    for (int j = 0; j < fuel_incommods.size(); j++) {
-      std::string commod = fuel_incommods[j];
-      double pref = fuel_prefs[j];
-      cyclus::Composition::Ptr recipe = context()->GetRecipe(fuel_inrecipes[j]);
-      m = Material::CreateUntracked(assem_size, recipe);
+    int max_index = 0;
+    for (int j = 0; j < fuel_slots_.size(); j++) {
+      const FuelSlot& slot = fuel_slots_[j];
+      m = Material::CreateUntracked(assem_size, slot.inrecipe);
 
-      Request<Material>* r = port->AddRequest(m, this, commod, pref, true);
+      Request<Material>* r =
+          port->AddRequest(m, this, slot.incommod, slot.pref, true);
       mreqs.push_back(r);
+      if (slot.pref > fuel_slots_[max_index].pref) {
+        max_index = j;
+      }
     }
 
-    std::vector<double>::iterator result;
-    result = std::max_element(fuel_prefs.begin(), fuel_prefs.end());
-    int max_index = std::distance(fuel_prefs.begin(), result);
-
-    cyclus::toolkit::RecordTimeSeries<double>("demand"+fuel_incommods[max_index], this,
+    cyclus::toolkit::RecordTimeSeries<double>("demand"+fuel_slots_[max_index].incommod, this,
                                           assem_size) ;
 
     port->AddMutualReqs(mreqs);
@@ -261,15 +668,29 @@ void Reactor::GetMatlTrades(
         responses) {
   using cyclus::Trade;
 
-  std::map<std::string, MatVec> mats = PopSpent();
   for (int i = 0; i < trades.size(); i++) {
     std::string commod = trades[i].request->commodity();
-    Material::Ptr m = mats[commod].back();
-    mats[commod].pop_back();
+    MatVec mats;
+    if (aggregate_bids) {
+      // aggregated bids are answered with whole assemblies that never add up
+      // to more than the traded amount
+      mats = PopSpent(commod, trades[i].bid->offer()->comp(), trades[i].amt);
+    } else {
+      mats = PopSpent(commod, 1);
+    }
+    if (mats.empty()) {
+      throw ValueError("cycamore::Reactor - no spent fuel left on commodity " +
+                       commod + " for prototype " + prototype());
+    }
+    for (int j = 0; j < mats.size(); j++) {
+      assem_index_.Erase(mats[j]->obj_id());
+    }
+    Material::Ptr m = mats[0];
+    for (int j = 1; j < mats.size(); j++) {
+      m->Absorb(mats[j]);
+    }
     responses.push_back(std::make_pair(trades[i], m));
-    res_indexes.erase(m->obj_id());
   }
-  PushSpent(mats);  // return leftovers back to spent buffer
 }
 
 void Reactor::AcceptMatlTrades(const std::vector<
@@ -277,76 +698,139 @@ void Reactor::AcceptMatlTrades(const std::vector<
   std::vector<std::pair<cyclus::Trade<Material>,
                         Material::Ptr> >::const_iterator trade;
 
-  std::stringstream ss;
-  int nload = std::min((int)responses.size(), n_assem_core - core.count());
-  if (nload > 0) {
-    ss << nload << " assemblies";
-    Record("LOAD", ss.str());
-  }
-
+  std::vector<std::pair<Material::Ptr, std::string> > assems;
   for (trade = responses.begin(); trade != responses.end(); ++trade) {
     std::string commod = trade->first.request->commodity();
-    Material::Ptr m = trade->second;
-    index_res(m, commod);
+    MatVec mats;
+    if (batch_requests) {
+      mats = SplitAssemblies(trade->second);
+    } else {
+      mats.push_back(trade->second);
+    }
+    for (int i = 0; i < mats.size(); i++) {
+      assems.push_back(std::make_pair(mats[i], commod));
+    }
+  }
+
+  MatVec loaded;
+  for (int i = 0; i < assems.size(); i++) {
+    Material::Ptr m = assems[i].first;
+    index_res(m, assems[i].second);
 
     if (core.count() < n_assem_core) {
       core.Push(m);
+      loaded.push_back(m);
     } else {
       fresh.Push(m);
     }
   }
+
+  if (loaded.size() > 0) {
+    Record(kEventLoad, loaded);
+    MarkLoaded(loaded);
+  }
+}
+
+MatVec Reactor::SplitAssemblies(Material::Ptr m) {
+  MatVec assems;
+  int n = static_cast<int>(std::floor(m->quantity() / assem_size + 0.5));
+  for (int i = 1; i < n; i++) {
+    assems.push_back(m->ExtractQty(assem_size));
+  }
+  // the remainder carries any round-off from the trade
+  assems.push_back(m);
+  return assems;
+}
+
+namespace {
+
+/// Spent assemblies sharing a composition, with the running total of their
+/// quantities in oldest-first order.
+struct SpentGroup {
+  cyclus::Composition::Ptr comp;
+  std::vector<double> cum_qty;
+
+  /// Returns the quantity of the most oldest assemblies that together do not
+  /// exceed qty, or of the oldest assembly alone if even that one does.
+  double Cover(double qty) const {
+    std::vector<double>::const_iterator it =
+        std::upper_bound(cum_qty.begin(), cum_qty.end(),
+                         qty + cyclus::eps_rsrc());
+    return it == cum_qty.begin() ? cum_qty.front() : *(it - 1);
+  }
+};
+
+std::vector<SpentGroup> GroupSpent(const std::deque<Material::Ptr>& mats) {
+  std::vector<SpentGroup> groups;
+  std::map<cyclus::Composition::Ptr, int> index;
+  for (int k = 0; k < mats.size(); k++) {
+    cyclus::Composition::Ptr c = mats[k]->comp();
+    std::map<cyclus::Composition::Ptr, int>::iterator it = index.find(c);
+    if (it == index.end()) {
+      it = index.insert(std::make_pair(c, groups.size())).first;
+      groups.push_back(SpentGroup());
+      groups.back().comp = c;
+    }
+    std::vector<double>& cum = groups[it->second].cum_qty;
+    cum.push_back(mats[k]->quantity() + (cum.empty() ? 0 : cum.back()));
+  }
+  return groups;
 }
 
+}  // namespace
+
 std::set<cyclus::BidPortfolio<Material>::Ptr> Reactor::GetMatlBids(
     cyclus::CommodMap<Material>::type& commod_requests) {
   using cyclus::BidPortfolio;
   std::set<BidPortfolio<Material>::Ptr> ports;
 
-  bool gotmats = false;
-  std::map<std::string, MatVec> all_mats;
-
-  if (uniq_outcommods_.empty()) {
-    for (int i = 0; i < fuel_outcommods.size(); i++) {
-      uniq_outcommods_.insert(fuel_outcommods[i]);
+  std::map<std::string, std::deque<Material::Ptr> >::iterator it;
+  for (it = spent.begin(); it != spent.end(); ++it) {
+    std::string commod = it->first;
+    std::deque<Material::Ptr>& mats = it->second;
+    if (mats.size() == 0) {
+      continue;
     }
-  }
-
-  std::set<std::string>::iterator it;
-  for (it = uniq_outcommods_.begin(); it != uniq_outcommods_.end(); ++it) {
-    std::string commod = *it;
     std::vector<Request<Material>*>& reqs = commod_requests[commod];
     if (reqs.size() == 0) {
       continue;
-    } else if (!gotmats) {
-      all_mats = PeekSpent();
-    }
-
-    MatVec mats = all_mats[commod];
-    if (mats.size() == 0) {
-      continue;
     }
 
     BidPortfolio<Material>::Ptr port(new BidPortfolio<Material>());
 
-    for (int j = 0; j < reqs.size(); j++) {
-      Request<Material>* req = reqs[j];
-      double tot_bid = 0;
-      for (int k = 0; k < mats.size(); k++) {
-        Material::Ptr m = mats[k];
-        tot_bid += m->quantity();
-        port->AddBid(req, m, this, true);
-        if (tot_bid >= req->target()->quantity()) {
-          break;
+    if (aggregate_bids) {
+      std::vector<SpentGroup> groups = GroupSpent(mats);
+      for (int j = 0; j < reqs.size(); j++) {
+        Request<Material>* req = reqs[j];
+        for (int g = 0; g < groups.size(); g++) {
+          Material::Ptr offer = Material::CreateUntracked(
+              groups[g].Cover(req->target()->quantity()), groups[g].comp);
+          port->AddBid(req, offer, this, true);
+        }
+      }
+      for (int g = 0; g < groups.size(); g++) {
+        cyclus::Converter<Material>::Ptr conv(
+            new CompConverter(groups[g].comp));
+        cyclus::CapacityConstraint<Material> cc(groups[g].cum_qty.back(),
+                                                conv);
+        port->AddConstraint(cc);
+      }
+    } else {
+      for (int j = 0; j < reqs.size(); j++) {
+        Request<Material>* req = reqs[j];
+        double tot_bid = 0;
+        for (int k = 0; k < mats.size(); k++) {
+          Material::Ptr m = mats[k];
+          tot_bid += m->quantity();
+          port->AddBid(req, m, this, true);
+          if (tot_bid >= req->target()->quantity()) {
+            break;
+          }
         }
       }
     }
 
-    double tot_qty = 0;
-    for (int j = 0; j < mats.size(); j++) {
-      tot_qty += mats[j]->quantity();
-    }
-
-    cyclus::CapacityConstraint<Material> cc(tot_qty);
+    cyclus::CapacityConstraint<Material> cc(spent_qty_[commod]);
     port->AddConstraint(cc);
     ports.insert(port);
   }
@@ -356,37 +840,40 @@ std::set<cyclus::BidPortfolio<Material>::Ptr> Reactor::GetMatlBids(
 
 void Reactor::Tock() {
   if (retired()) {
+    // a retired reactor holding spent fuel may never be decommissioned
+    CloseIntervals();
     return;
   }
   
   // Check that irradiation and refueling periods are over, that 
   // the core is full and that fuel was successfully discharged in this refueling time.
   // If this is the case, then a new cycle will be initiated.
-  if (cycle_step >= cycle_time + refuel_time && core.count() == n_assem_core && discharged == true) {
+  CoreCycle cc = core_cycle();
+  if (cc.Restarts(cycle_step, core.count(), discharged)) {
     discharged = false;
     cycle_step = 0;
   }
 
-  if (cycle_step == 0 && core.count() == n_assem_core) {
-    Record("CYCLE_START", "");
+  if (cc.Starts(cycle_step, core.count())) {
+    Record(kEventCycleStart);
   }
 
-  if (cycle_step >= 0 && cycle_step < cycle_time &&
-      core.count() == n_assem_core) {
-    cyclus::toolkit::RecordTimeSeries<cyclus::toolkit::POWER>(this, power_cap);
-    cyclus::toolkit::RecordTimeSeries<double>("supplyPOWER", this, power_cap);
+  if (cc.Operating(cycle_step, core.count())) {
+    RecordPower(power_cap);
     RecordSideProduct(true);
+    if (!burnup_commods.empty()) {
+      op_steps++;
+    }
   } else {
-    cyclus::toolkit::RecordTimeSeries<cyclus::toolkit::POWER>(this, 0);
-    cyclus::toolkit::RecordTimeSeries<double>("supplyPOWER", this, 0);
+    RecordPower(0);
     RecordSideProduct(false);
   }
-
-  // "if" prevents starting cycle after initial deployment until core is full
-  // even though cycle_step is its initial zero.
-  if (cycle_step > 0 || core.count() == n_assem_core) {
-    cycle_step++;
+  if (record_intervals &&
+      context()->time() == context()->sim_info().duration - 1) {
+    CloseIntervals();
   }
+
+  cycle_step = cc.Advance(cycle_step, core.count());
 }
 
 void Reactor::Transmute() { Transmute(n_assem_batch); }
@@ -399,48 +886,100 @@ void Reactor::Transmute(int n_assem) {
     core.Push(core.PopN(core.count() - old.size()));
   }
 
-  std::stringstream ss;
-  ss << old.size() << " assemblies";
-  Record("TRANSMUTE", ss.str());
+  Record(kEventTransmute, old);
 
   for (int i = 0; i < old.size(); i++) {
-    old[i]->Transmute(context()->GetRecipe(fuel_outrecipe(old[i])));
+    old[i]->Transmute(DischargeComp(old[i]));
   }
 }
 
-std::map<std::string, MatVec> Reactor::PeekSpent() {
-  std::map<std::string, MatVec> mapped;
-  MatVec mats = spent.PopN(spent.count());
-  spent.Push(mats);
+cyclus::Composition::Ptr Reactor::DischargeComp(Material::Ptr m) {
+  int i = res_index(m);
+  const FuelSlot& slot = fuel_slot(m);
+  if (slot.burnup.empty()) {
+    return slot.outrecipe;
+  }
+
+  int t = op_steps;
+  std::map<int, int>::iterator loaded = load_steps.find(m->obj_id());
+  if (loaded != load_steps.end()) {
+    t -= loaded->second;
+    load_steps.erase(loaded);
+  }
+
+  const std::vector<std::pair<int, cyclus::Composition::Ptr> >& table =
+      slot.burnup;
+  if (t <= table.front().first) {
+    return table.front().second;
+  } else if (t >= table.back().first) {
+    return table.back().second;
+  }
+  int hi = 1;
+  while (table[hi].first < t) {
+    hi++;
+  }
+  if (table[hi].first == t) {
+    return table[hi].second;
+  }
+
+  std::pair<int, int> key(i, t);
+  std::map<std::pair<int, int>, cyclus::Composition::Ptr>::iterator it =
+      burnup_comps_.find(key);
+  if (it != burnup_comps_.end()) {
+    return it->second;
+  }
+
+  // interpolated compositions are registered as recipes so they are
+  // persisted and reused after a restart
+  std::stringstream ss;
+  ss << "burnup:" << id() << ":" << slot.incommod << ":" << t;
+  std::string name = ss.str();
+  if (burnup_comp_recipes.count(name) > 0) {
+    burnup_comps_[key] = context()->GetRecipe(name);
+    return burnup_comps_[key];
+  }
+
+  const std::pair<int, cyclus::Composition::Ptr>& a = table[hi - 1];
+  const std::pair<int, cyclus::Composition::Ptr>& b = table[hi];
+  double f = static_cast<double>(t - a.first) / (b.first - a.first);
+  cyclus::CompMap ma = a.second->mass();
+  cyclus::CompMap mb = b.second->mass();
+  cyclus::compmath::Normalize(&ma, 1 - f);
+  cyclus::compmath::Normalize(&mb, f);
+  cyclus::Composition::Ptr comp =
+      cyclus::Composition::CreateFromMass(cyclus::compmath::Add(ma, mb));
+  context()->AddRecipe(name, comp);
+  burnup_comp_recipes.insert(name);
+  burnup_comps_[key] = comp;
+  return comp;
+}
+
+void Reactor::MarkLoaded(const MatVec& mats) {
+  if (burnup_commods.empty()) {
+    return;
+  }
   for (int i = 0; i < mats.size(); i++) {
-    std::string commod = fuel_outcommod(mats[i]);
-    mapped[commod].push_back(mats[i]);
+    load_steps[mats[i]->obj_id()] = op_steps;
   }
-  return mapped;
 }
 
 bool Reactor::Discharge() {
-  int npop = std::min(n_assem_batch, core.count());
-  if (n_assem_spent - spent.count() < npop) {
-    Record("DISCHARGE", "failed");
+  int npop = core_cycle().NDischarge(core.count());
+  if (n_assem_spent - n_spent_ < npop) {
+    Record(kEventDischargeFailed);
     return false;  // not enough room in spent buffer
   }
 
-  std::stringstream ss;
-  ss << npop << " assemblies";
-  Record("DISCHARGE", ss.str());
-  spent.Push(core.PopN(npop));
+  MatVec mats = core.PopN(npop);
+  Record(kEventDischarge, mats, true);
+  for (int i = 0; !load_steps.empty() && i < mats.size(); i++) {
+    load_steps.erase(mats[i]->obj_id());
+  }
+  PushSpent(mats);
 
-  std::map<std::string, MatVec> spent_mats;
-  for (int i = 0; i < fuel_outcommods.size(); i++) {
-    spent_mats = PeekSpent();
-    MatVec mats = spent_mats[fuel_outcommods[i]];
-    double tot_spent = 0;
-    for (int j = 0; j<mats.size(); j++){
-      Material::Ptr m = mats[j];
-      tot_spent += m->quantity();
-    }
-    cyclus::toolkit::RecordTimeSeries<double>("supply"+fuel_outcommods[i], this, tot_spent);
+  for (int i = 0; i < fuel_slots_.size(); i++) {
+    std::string commod = fuel_slots_[i].outcommod;
+    cyclus::toolkit::RecordTimeSeries<double>("supply"+commod, this, spent_qty_[commod]);
   }
 
   return true;
@@ -452,56 +991,40 @@ void Reactor::Load() {
     return;
   }
 
-  std::stringstream ss;
-  ss << n << " assemblies";
-  Record("LOAD", ss.str());
-  core.Push(fresh.PopN(n));
+  MatVec mats = fresh.PopN(n);
+  Record(kEventLoad, mats);
+  MarkLoaded(mats);
+  core.Push(mats);
 }
 
 std::string Reactor::fuel_incommod(Material::Ptr m) {
-  int i = res_indexes[m->obj_id()];
-  if (i >= fuel_incommods.size()) {
-    throw KeyError("cycamore::Reactor - no incommod for material object");
-  }
-  return fuel_incommods[i];
+  return fuel_slot(m).incommod;
 }
 
 std::string Reactor::fuel_outcommod(Material::Ptr m) {
-  int i = res_indexes[m->obj_id()];
-  if (i >= fuel_outcommods.size()) {
-    throw KeyError("cycamore::Reactor - no outcommod for material object");
-  }
-  return fuel_outcommods[i];
+  return fuel_slot(m).outcommod;
 }
 
 std::string Reactor::fuel_inrecipe(Material::Ptr m) {
-  int i = res_indexes[m->obj_id()];
-  if (i >= fuel_inrecipes.size()) {
-    throw KeyError("cycamore::Reactor - no inrecipe for material object");
-  }
-  return fuel_inrecipes[i];
+  return fuel_slot(m).inrecipe_name;
 }
 
 std::string Reactor::fuel_outrecipe(Material::Ptr m) {
-  int i = res_indexes[m->obj_id()];
-  if (i >= fuel_outrecipes.size()) {
-    throw KeyError("cycamore::Reactor - no outrecipe for material object");
-  }
-  return fuel_outrecipes[i];
+  return fuel_slot(m).outrecipe_name;
 }
 
 double Reactor::fuel_pref(Material::Ptr m) {
-  int i = res_indexes[m->obj_id()];
-  if (i >= fuel_prefs.size()) {
+  int i = res_index(m);
+  if (i < 0 || i >= fuel_slots_.size()) {
     return 0;
   }
-  return fuel_prefs[i];
+  return fuel_slots_[i].pref;
 }
 
 void Reactor::index_res(cyclus::Resource::Ptr m, std::string incommod) {
-  for (int i = 0; i < fuel_incommods.size(); i++) {
-    if (fuel_incommods[i] == incommod) {
-      res_indexes[m->obj_id()] = i;
+  for (int i = 0; i < fuel_slots_.size(); i++) {
+    if (fuel_slots_[i].incommod == incommod) {
+      assem_index_.Set(m->obj_id(), i);
       return;
     }
   }
@@ -509,29 +1032,82 @@ void Reactor::index_res(cyclus::Resource::Ptr m, std::string incommod) {
       "cycamore::Reactor - received unsupported incommod material");
 }
 
-std::map<std::string, MatVec> Reactor::PopSpent() {
-  MatVec mats = spent.PopN(spent.count());
-  std::map<std::string, MatVec> mapped;
-  for (int i = 0; i < mats.size(); i++) {
-    std::string commod = fuel_outcommod(mats[i]);
-    mapped[commod].push_back(mats[i]);
+int Reactor::res_index(Material::Ptr m) {
+  return assem_index_.Get(m->obj_id());
+}
+
+const FuelSlot& Reactor::fuel_slot(Material::Ptr m) {
+  int i = res_index(m);
+  if (i < 0 || i >= fuel_slots_.size()) {
+    throw KeyError("cycamore::Reactor - no fuel slot for material object");
   }
+  return fuel_slots_[i];
+}
 
-  // needed so we trade away oldest assemblies first
-  std::map<std::string, MatVec>::iterator it;
-  for (it = mapped.begin(); it != mapped.end(); ++it) {
-    std::reverse(it->second.begin(), it->second.end());
+MatVec Reactor::PopSpent(std::string commod, int n) {
+  MatVec mats;
+  std::map<std::string, std::deque<Material::Ptr> >::iterator it =
+      spent.find(commod);
+  if (it == spent.end()) {
+    return mats;
   }
 
-  return mapped;
+  // oldest assemblies are at the front so we trade them away first
+  std::deque<Material::Ptr>& q = it->second;
+  n = std::min(n, static_cast<int>(q.size()));
+  for (int i = 0; i < n; i++) {
+    mats.push_back(q.front());
+    spent_qty_[commod] -= q.front()->quantity();
+    q.pop_front();
+  }
+  if (q.empty()) {
+    spent_qty_[commod] = 0;  // prevent round-off accumulation
+  }
+  n_spent_ -= n;
+  return mats;
 }
 
-void Reactor::PushSpent(std::map<std::string, MatVec> leftover) {
-  std::map<std::string, MatVec>::iterator it;
-  for (it = leftover.begin(); it != leftover.end(); ++it) {
-    // undo reverse in PopSpent to make sure oldest assemblies come out first
-    std::reverse(it->second.begin(), it->second.end());
-    spent.Push(it->second);
+MatVec Reactor::PopSpent(std::string commod, cyclus::Composition::Ptr comp,
+                         double qty) {
+  MatVec mats;
+  std::map<std::string, std::deque<Material::Ptr> >::iterator it =
+      spent.find(commod);
+  if (it == spent.end()) {
+    return mats;
+  }
+
+  std::deque<Material::Ptr>& q = it->second;
+  std::deque<Material::Ptr>::iterator m = q.begin();
+  double popped = 0;
+  while (m != q.end()) {
+    if ((*m)->comp() != comp) {
+      ++m;
+      continue;
+    }
+    // always hand over at least one assembly, but never overshoot qty after
+    // that
+    if (!mats.empty() &&
+        popped + (*m)->quantity() > qty + cyclus::eps_rsrc()) {
+      break;
+    }
+    popped += (*m)->quantity();
+    spent_qty_[commod] -= (*m)->quantity();
+    mats.push_back(*m);
+    m = q.erase(m);
+  }
+  if (q.empty()) {
+    spent_qty_[commod] = 0;  // prevent round-off accumulation
+  }
+  n_spent_ -= mats.size();
+  return mats;
+}
+
+void Reactor::PushSpent(MatVec mats) {
+  for (int i = 0; i < mats.size(); i++) {
+    std::string commod = fuel_outcommod(mats[i]);
+    spent[commod].push_back(mats[i]);
+    spent_qty_[commod] += mats[i]->quantity();
+    n_spent_++;
   }
 }
 
@@ -546,6 +1122,12 @@ void Reactor::RecordSideProduct(bool produce){
           value = 0;
       }
 
+      if (record_intervals) {
+        RecordInterval(i + 1, value);
+        if (!expand_intervals) {
+          continue;
+        }
+      }
       context()
           ->NewDatum("ReactorSideProducts")
           ->AddVal("AgentId", id())
@@ -557,6 +1139,139 @@ void Reactor::RecordSideProduct(bool produce){
   }
 }
 
+void Reactor::RecordPower(double value) {
+  if (record_intervals) {
+    RecordInterval(0, value);
+    if (!expand_intervals) {
+      return;
+    }
+  }
+  cyclus::toolkit::RecordTimeSeries<cyclus::toolkit::POWER>(this, value);
+  cyclus::toolkit::RecordTimeSeries<double>("supplyPOWER", this, value);
+}
+
+void Reactor::RecordInterval(int series, double value) {
+  int t = context()->time();
+  if (interval_starts[series] >= 0 && interval_ends[series] == t - 1 &&
+      interval_values[series] == value) {
+    interval_ends[series] = t;
+    return;
+  }
+  CloseInterval(series);
+  interval_starts[series] = t;
+  interval_ends[series] = t;
+  interval_values[series] = value;
+}
+
+void Reactor::CloseInterval(int series) {
+  if (interval_starts[series] < 0) {
+    return;
+  }
+
+  std::string name = series == 0 ? "Power" : side_products[series - 1];
+  context()
+      ->NewDatum("ReactorIntervals")
+      ->AddVal("AgentId", id())
+      ->AddVal("Series", name)
+      ->AddVal("StartTime", interval_starts[series])
+      ->AddVal("EndTime", interval_ends[series])
+      ->AddVal("Value", interval_values[series])
+      ->Record();
+  interval_starts[series] = -1;
+}
+
+void Reactor::CloseIntervals() {
+  for (int i = 0; i < interval_starts.size(); i++) {
+    CloseInterval(i);
+  }
+}
+
+void Reactor::Record(ReactorEvent event, const MatVec& mats, bool out) {
+  static const char* names[] = {"CYCLE_START", "CYCLE_END", "LOAD",
+                                "DISCHARGE", "DISCHARGE", "TRANSMUTE",
+                                "RETIRED"};
+  bool has_assems = event == kEventLoad || event == kEventDischarge ||
+                    event == kEventTransmute;
+
+  if (legacy_events) {
+    std::string val;
+    if (event == kEventDischargeFailed) {
+      val = "failed";
+    } else if (has_assems) {
+      std::stringstream ss;
+      ss << mats.size() << " assemblies";
+      val = ss.str();
+    }
+    Record(names[event], val);
+  }
+
+  if (!has_assems || mats.empty()) {
+    context()
+        ->NewDatum("ReactorEventLog")
+        ->AddVal("AgentId", id())
+        ->AddVal("Time", context()->time())
+        ->AddVal("Event", static_cast<int>(event))
+        ->AddVal("Commodity", std::string(""))
+        ->AddVal("NAssemblies", 0)
+        ->AddVal("Quantity", 0.0)
+        ->Record();
+    return;
+  }
+
+  // tally per fuel slot, then merge slots that share a commodity.
+  // Assemblies without a fuel slot are tallied under an empty commodity.
+  std::vector<int> n(fuel_slots_.size(), 0);
+  std::vector<double> qty(fuel_slots_.size(), 0);
+  int n_unknown = 0;
+  double qty_unknown = 0;
+  for (int i = 0; i < mats.size(); i++) {
+    int j = res_index(mats[i]);
+    if (j < 0) {
+      n_unknown++;
+      qty_unknown += mats[i]->quantity();
+      continue;
+    }
+    n[j]++;
+    qty[j] += mats[i]->quantity();
+  }
+  if (n_unknown > 0) {
+    context()
+        ->NewDatum("ReactorEventLog")
+        ->AddVal("AgentId", id())
+        ->AddVal("Time", context()->time())
+        ->AddVal("Event", static_cast<int>(event))
+        ->AddVal("Commodity", std::string(""))
+        ->AddVal("NAssemblies", n_unknown)
+        ->AddVal("Quantity", qty_unknown)
+        ->Record();
+  }
+  for (int j = 0; j < fuel_slots_.size(); j++) {
+    if (n[j] == 0) {
+      continue;
+    }
+    const std::string& commod =
+        out ? fuel_slots_[j].outcommod : fuel_slots_[j].incommod;
+    for (int k = j + 1; k < fuel_slots_.size(); k++) {
+      const std::string& other =
+          out ? fuel_slots_[k].outcommod : fuel_slots_[k].incommod;
+      if (other == commod) {
+        n[j] += n[k];
+        qty[j] += qty[k];
+        n[k] = 0;
+      }
+    }
+    context()
+        ->NewDatum("ReactorEventLog")
+        ->AddVal("AgentId", id())
+        ->AddVal("Time", context()->time())
+        ->AddVal("Event", static_cast<int>(event))
+        ->AddVal("Commodity", commod)
+        ->AddVal("NAssemblies", n[j])
+        ->AddVal("Quantity", qty[j])
+        ->Record();
+  }
+}
+
 void Reactor::Record(std::string name, std::string val) {
   context()
       ->NewDatum("ReactorEvents")
@@ -1,11 +1,206 @@
 #ifndef CYCAMORE_SRC_REACTOR_H_
 #define CYCAMORE_SRC_REACTOR_H_
 
+#include <deque>
+#include <sstream>
+
 #include "cyclus.h"
 #include "cycamore_version.h"
 
 namespace cycamore {
 
+/// AssemblyIndex maps the resource object ids of the assemblies held by a
+/// reactor to the index of the fuel (i.e. incommod) they were received as.
+/// It is a flat open-addressing hash table whose allocation grows and shrinks
+/// with the number of assemblies actually held, so lookups are O(1) and
+/// entries for assemblies that leave the reactor do not accumulate.
+class AssemblyIndex {
+ public:
+  AssemblyIndex();
+
+  /// Returns the fuel index for the given object id or -1 if the id is not
+  /// present.
+  int Get(int obj_id) const;
+
+  /// Sets the fuel index for the given object id.
+  void Set(int obj_id, int fuel_index);
+
+  /// Removes the given object id.  Returns true if it was present.
+  bool Erase(int obj_id);
+
+  /// Removes all entries and releases the table's memory.
+  void Clear();
+
+  /// Returns the number of object ids stored.
+  int size() const { return size_; }
+
+  /// Returns the number of allocated table entries.
+  int capacity() const { return entries_.size(); }
+
+  /// Returns the length of the longest probe sequence in the table.
+  int MaxProbe() const;
+
+  /// Returns all (object id, fuel index) entries as an ordered map - used for
+  /// persisting the table.
+  std::map<int, int> ToMap() const;
+
+ private:
+  struct Entry {
+    int obj_id;
+    int fuel_index;
+  };
+
+  /// Returns the position of obj_id in entries_ or -1 if not present.
+  int Find(int obj_id) const;
+
+  /// Returns the preferred position for obj_id in entries_.
+  int Home(int obj_id) const;
+
+  /// Reallocates the table with n entries and reinserts all stored ids.
+  void Resize(int n);
+
+  std::vector<Entry> entries_;
+  int size_;
+  // 32 - log2(capacity())
+  int shift_;
+};
+
+/// FuelSlot holds the resolved specification of one of a reactor's fuel
+/// types.  A slot's index is the same as the index of its input commodity in
+/// the reactor's fuel_incommods.
+struct FuelSlot {
+  std::string incommod;
+  std::string outcommod;
+  double pref;
+  std::string inrecipe_name;
+  std::string outrecipe_name;
+  cyclus::Composition::Ptr inrecipe;
+  cyclus::Composition::Ptr outrecipe;
+  /// discharge recipes indexed by the number of operating time steps an
+  /// assembly spent in the core, sorted by time - empty if the fuel always
+  /// discharges as outrecipe.
+  std::vector<std::pair<int, cyclus::Composition::Ptr> > burnup;
+};
+
+/// FuelChange is a scheduled reactor fuel preference or recipe change that
+/// has been resolved to the index of the fuel it applies to.
+struct FuelChange {
+  /// time step on which the change occurs
+  int time;
+  /// index into the reactor's fuel_incommods
+  int fuel_index;
+  /// index into the pref_change_* or recipe_change_* vars
+  int change_index;
+  /// true for a recipe change, false for a preference change
+  bool recipe;
+};
+
+/// Appends a message to ss for each of the fuel specification lists that does
+/// not have one value per input commodity.
+void CheckFuelSpecs(const std::string& prototype,
+                    const std::vector<std::string>& incommods,
+                    const std::vector<std::string>& inrecipes,
+                    const std::vector<std::string>& outcommods,
+                    const std::vector<std::string>& outrecipes,
+                    const std::vector<double>& prefs,
+                    std::stringstream& ss);
+
+/// Returns one fuel slot per input commodity with its recipes resolved in
+/// ctx.  Fuels without a preference get cyclus::kDefaultPref.
+std::vector<FuelSlot> MakeFuelSlots(cyclus::Context* ctx,
+                                    const std::vector<std::string>& incommods,
+                                    const std::vector<std::string>& inrecipes,
+                                    const std::vector<std::string>& outcommods,
+                                    const std::vector<std::string>& outrecipes,
+                                    const std::vector<double>& prefs);
+
+/// CoreCycle implements the operating cycle of a single reactor core.  It is
+/// shared by the Reactor and the units of a ReactorFleet, which hold the
+/// core's state (cycle step, number of core and fresh assemblies) themselves
+/// and ask CoreCycle what the core does on each time step.
+class CoreCycle {
+ public:
+  CoreCycle(int cycle_time, int refuel_time, int n_assem_core,
+            int n_assem_batch, int n_assem_fresh);
+
+  /// Returns true if the core's batch is burnt on this cycle step.
+  bool Ends(int cycle_step) const { return cycle_step == cycle_time_; }
+
+  /// Returns true if the core is refueling (i.e. discharging and loading
+  /// fuel) on this cycle step.
+  bool Refueling(int cycle_step) const { return cycle_step >= cycle_time_; }
+
+  /// Returns true if a new cycle starts - the refueling period is over, the
+  /// core is full and the last batch was discharged.
+  bool Restarts(int cycle_step, int n_core, bool discharged) const;
+
+  /// Returns true if the core is at the start of a cycle.
+  bool Starts(int cycle_step, int n_core) const;
+
+  /// Returns true if the core produces power on this cycle step.
+  bool Operating(int cycle_step, int n_core) const;
+
+  /// Returns the cycle step following this one.
+  int Advance(int cycle_step, int n_core) const;
+
+  /// Returns the number of assemblies discharged at the end of a cycle.
+  int NDischarge(int n_core) const;
+
+  /// Returns the number of assemblies burnt when the core is decommissioned.
+  int NDecomTransmute(bool all) const;
+
+  /// Returns the number of assemblies to order to fill the core and fresh
+  /// fuel inventory, reduced to what can still be burnt before exit_time
+  /// (-1 for none).
+  int NOrder(int cycle_step, int n_core, int n_fresh, int exit_time,
+             int time) const;
+
+ private:
+  int cycle_time_;
+  int refuel_time_;
+  int n_assem_core_;
+  int n_assem_batch_;
+  int n_assem_fresh_;
+};
+
+/// CompConverter counts an offer against a capacity only if it has the given
+/// composition, so that spent fuel of each composition is constrained by its
+/// own inventory.
+class CompConverter : public cyclus::Converter<cyclus::Material> {
+ public:
+  explicit CompConverter(cyclus::Composition::Ptr comp) : comp_(comp) {}
+  virtual ~CompConverter() {}
+
+  virtual double convert(
+      cyclus::Material::Ptr m,
+      cyclus::Arc const * a = NULL,
+      cyclus::ExchangeTranslationContext<cyclus::Material>
+          const * ctx = NULL) const {
+    return m->comp() == comp_ ? m->quantity() : 0;
+  }
+
+  /// @returns true if Converter is a CompConverter for the same composition
+  virtual bool operator==(Converter& other) const {
+    CompConverter* cast = dynamic_cast<CompConverter*>(&other);
+    return cast != NULL && cast->comp_ == comp_;
+  }
+
+ private:
+  cyclus::Composition::Ptr comp_;
+};
+
+/// ReactorEvent codes are recorded in the Event column of the ReactorEventLog
+/// table.
+enum ReactorEvent {
+  kEventCycleStart = 0,
+  kEventCycleEnd = 1,
+  kEventLoad = 2,
+  kEventDischarge = 3,
+  kEventDischargeFailed = 4,
+  kEventTransmute = 5,
+  kEventRetired = 6,
+};
+
 /// Reactor is a simple, general reactor based on static compositional
 /// transformations to model fuel burnup.  The user specifies a set of input
 /// fuels and corresponding burnt compositions that fuel is transformed to when
@@ -116,6 +311,7 @@ class Reactor : public cyclus::Facility,
   virtual void Tock();
   virtual void EnterNotify();
   virtual bool CheckDecommissionCondition();
+  virtual void Decommission();
 
   virtual void AcceptMatlTrades(const std::vector<std::pair<
       cyclus::Trade<cyclus::Material>, cyclus::Material::Ptr> >& responses);
@@ -131,6 +327,10 @@ class Reactor : public cyclus::Facility,
       std::vector<std::pair<cyclus::Trade<cyclus::Material>,
                             cyclus::Material::Ptr> >& responses);
 
+  /// Returns the time step of the next scheduled preference or recipe change
+  /// at or after the current time step or -1 if there are none left.
+  int NextFuelChangeTime() const;
+
   #pragma cyclus decl
 
  private:
@@ -143,13 +343,52 @@ class Reactor : public cyclus::Facility,
   std::string fuel_outrecipe(cyclus::Material::Ptr m);
   double fuel_pref(cyclus::Material::Ptr m);
 
+  /// Returns the cycle logic for this reactor's core.
+  CoreCycle core_cycle() const {
+    return CoreCycle(cycle_time, refuel_time, n_assem_core, n_assem_batch,
+                     n_assem_fresh);
+  }
+
   bool retired() {
     return exit_time() != -1 && context()->time() > exit_time();
   }
 
+  /// Splits material received in batch request mode into assembly-sized
+  /// pieces.
+  cyclus::toolkit::MatVec SplitAssemblies(cyclus::Material::Ptr m);
+
   /// Store fuel info index for the given resource received on incommod.
   void index_res(cyclus::Resource::Ptr m, std::string incommod);
 
+  /// Returns the fuel info index for the given material or -1 if the
+  /// material was not received by this reactor.
+  int res_index(cyclus::Material::Ptr m);
+
+  /// Returns the fuel slot for the given material, which must have been
+  /// received by this reactor.
+  const FuelSlot& fuel_slot(cyclus::Material::Ptr m);
+
+  /// Resolves the fuel_* vars into fuel_slots_.
+  void BuildFuelSlots();
+
+  /// Compiles the pref_change_* and recipe_change_* vars into a time-sorted
+  /// schedule of fuel changes.
+  void ScheduleFuelChanges();
+
+  /// Applies the given scheduled fuel change.
+  void ApplyFuelChange(const FuelChange& c);
+
+  /// Moves the fuel change schedule cursor past changes for past time steps.
+  void SkipPastFuelChanges();
+
+  /// Returns the composition an assembly is transmuted to on leaving the core
+  /// - interpolated from its fuel's burnup table if it has one.
+  cyclus::Composition::Ptr DischargeComp(cyclus::Material::Ptr m);
+
+  /// Notes the operating time at which the given assemblies entered the core
+  /// if any fuel has a burnup table.
+  void MarkLoaded(const cyclus::toolkit::MatVec& mats);
+
   /// Discharge a batch from the core if there is room in the spent fuel
   /// inventory.  Returns true if a batch was successfully discharged.
   bool Discharge();
@@ -168,20 +407,43 @@ class Reactor : public cyclus::Facility,
   /// fully burnt state as defined by their outrecipe.
   void Transmute(int n_assem);
 
-  /// Records a reactor event to the output db with the given name and note val.
+  /// Records the reactor's power output for the current time step.
+  void RecordPower(double value);
+
+  /// Extends or restarts the run for the given series (0 for power, i+1 for
+  /// side product i) with value on the current time step.
+  void RecordInterval(int series, double value);
+
+  /// Writes the given series' open run to the output db and closes it.
+  void CloseInterval(int series);
+
+  /// Closes all open runs.
+  void CloseIntervals();
+
+  /// Records a reactor event to the output db involving the given
+  /// assemblies, broken down by the outcommod (if out is true) or incommod
+  /// each assembly is associated with.
+  void Record(ReactorEvent event,
+              const cyclus::toolkit::MatVec& mats = cyclus::toolkit::MatVec(),
+              bool out = false);
+
+  /// Records a reactor event to the legacy ReactorEvents table with the given
+  /// name and note val.
   void Record(std::string name, std::string val);
 
-  /// Complement of PopSpent - must be called with all materials passed that
-  /// were not traded away to other agents.
-  void PushSpent(std::map<std::string, cyclus::toolkit::MatVec> leftover);
+  /// Adds the given assemblies to the back of the spent fuel inventory for
+  /// their respective outcommods.
+  void PushSpent(cyclus::toolkit::MatVec mats);
 
-  /// Returns all spent assemblies indexed by outcommod - removing them from
-  /// the spent fuel buffer.
-  std::map<std::string, cyclus::toolkit::MatVec> PopSpent();
+  /// Removes and returns up to n of the oldest spent assemblies offered on
+  /// the given outcommod.
+  cyclus::toolkit::MatVec PopSpent(std::string commod, int n);
 
-  /// Returns all spent assemblies indexed by outcommod without removing them
-  /// from the spent fuel buffer.
-  std::map<std::string, cyclus::toolkit::MatVec> PeekSpent();
+  /// Removes and returns the oldest spent assemblies offered on the given
+  /// outcommod with the given composition, as many as fit in qty but at
+  /// least one.
+  cyclus::toolkit::MatVec PopSpent(std::string commod,
+                                   cyclus::Composition::Ptr comp, double qty);
 
   /////// fuel specifications /////////
   #pragma cyclus var { \
@@ -227,6 +489,39 @@ class Reactor : public cyclus::Facility,
   }
   std::vector<std::string> fuel_outrecipes;
 
+  ///////////// burnup dependent recipes ///////////
+  #pragma cyclus var { \
+    "default": [], \
+    "uilabel": "Commodity for Burnup Dependent Spent Fuel Recipe", \
+    "doc": "The input commodity of the fuel a burnup table entry applies to. " \
+           "Fuel with burnup table entries is transmuted to a composition " \
+           "interpolated (by mass fraction) between the entries bracketing " \
+           "the number of operating time steps each assembly actually " \
+           "spent in the core, instead of to its fixed output recipe. " \
+           "Outside the table the nearest entry is used.", \
+    "uitype": ["oneormore", "incommodity"], \
+  }
+  std::vector<std::string> burnup_commods;
+
+  #pragma cyclus var { \
+    "default": [], \
+    "uilabel": "Operating Time for Burnup Dependent Spent Fuel Recipe", \
+    "doc": "The number of operating time steps spent in the core for each " \
+           "burnup table entry. Same order as and direct correspondence to " \
+           "the specified burnup commodities.", \
+    "units": "time steps", \
+  }
+  std::vector<int> burnup_times;
+
+  #pragma cyclus var { \
+    "default": [], \
+    "uilabel": "Burnup Dependent Spent Fuel Recipe", \
+    "doc": "The spent fuel recipe for each burnup table entry. Same order as " \
+           "and direct correspondence to the specified burnup commodities.", \
+    "uitype": ["oneormore", "outrecipe"], \
+  }
+  std::vector<std::string> burnup_recipes;
+
   ///////////// recipe changes ///////////
   #pragma cyclus var { \
     "default": [], \
@@ -395,6 +690,45 @@ class Reactor : public cyclus::Facility,
   bool decom_transmute_all;
 
 
+  /////////// output options ///////////
+  #pragma cyclus var { \
+    "default": False, \
+    "tooltip": "Whether to record power and side products as intervals", \
+    "doc": "If true, power and side product output is recorded to the " \
+           "ReactorIntervals table as one row per run of time steps with " \
+           "an unchanged value (StartTime and EndTime inclusive) instead " \
+           "of one row per time step in the TimeSeriesPower, " \
+           "TimeSeriessupplyPOWER and ReactorSideProducts tables. Unless " \
+           "expand_intervals is set, time series listeners are not " \
+           "notified of power in this mode.", \
+    "uilabel": "Record Output Intervals", \
+    "uitype": "bool"}
+  bool record_intervals;
+
+  #pragma cyclus var { \
+    "default": False, \
+    "tooltip": "Whether to also expand recorded intervals to per-step rows", \
+    "doc": "If true and record_intervals is true, power and side " \
+           "products are also recorded every time step in the " \
+           "TimeSeriesPower, TimeSeriessupplyPOWER and ReactorSideProducts " \
+           "tables, for compatibility with tools that read those tables.", \
+    "uilabel": "Expand Output Intervals", \
+    "uitype": "bool"}
+  bool expand_intervals;
+
+  #pragma cyclus var { \
+    "default": True, \
+    "tooltip": "Whether to also record events as text in ReactorEvents", \
+    "doc": "Reactor events are always recorded with numeric event codes, " \
+           "assembly counts and quantities per commodity in the " \
+           "ReactorEventLog table. If true, they are also recorded as " \
+           "text in the legacy ReactorEvents table. Set to false to skip " \
+           "the text table.", \
+    "uilabel": "Record Legacy Events", \
+    "uitype": "bool"}
+  bool legacy_events;
+
+
   /////////// preference changes ///////////
   #pragma cyclus var { \
     "default": [], \
@@ -435,14 +769,49 @@ class Reactor : public cyclus::Facility,
     "uitype": "bool"}
   bool keep_packaging;
 
+  #pragma cyclus var { \
+    "default": False, \
+    "tooltip": "Whether to request fresh fuel a whole order at a time", \
+    "doc": "If true, the reactor requests all of the assemblies it needs on " \
+           "a time step as a single all-or-nothing request per fresh fuel " \
+           "commodity instead of one request per assembly. Received " \
+           "material is split into assembly-sized pieces on acceptance. " \
+           "This shrinks the exchange considerably for large fleets, but " \
+           "an order can no longer be filled from several suppliers or " \
+           "commodities.", \
+    "uilabel": "Batch Fuel Requests", \
+    "uitype": "bool"}
+  bool batch_requests;
+
+  #pragma cyclus var { \
+    "default": False, \
+    "tooltip": "Whether to bid spent fuel per composition instead of per assembly", \
+    "doc": "If true, the reactor offers each spent fuel request one bid per " \
+           "distinct spent fuel composition covering as many of the oldest " \
+           "assemblies of that composition as fit in the request, instead " \
+           "of one bid per assembly. Each trade is fulfilled with a single " \
+           "material made of whole assemblies, oldest first.", \
+    "uilabel": "Aggregate Spent Fuel Bids", \
+    "uitype": "bool"}
+  bool aggregate_bids;
+
   // Resource inventories - these must be defined AFTER/BELOW the member vars
   // referenced (e.g. n_batch_fresh, assem_size, etc.).
   #pragma cyclus var {"capacity": "n_assem_fresh * assem_size"}
   cyclus::toolkit::ResBuf<cyclus::Material> fresh;
   #pragma cyclus var {"capacity": "n_assem_core * assem_size"}
   cyclus::toolkit::ResBuf<cyclus::Material> core;
-  #pragma cyclus var {"capacity": "n_assem_spent * assem_size"}
-  cyclus::toolkit::ResBuf<cyclus::Material> spent;
+
+  // Spent fuel inventory indexed by outcommod.  Assemblies for each commodity
+  // are kept in discharge order (oldest first) so trades and bids only touch
+  // the assemblies they need.  Capacity is n_assem_spent assemblies total.
+  // Custom SnapshotInv and InitInv persist this under the "spent" inventory
+  // name.
+  std::map<std::string, std::deque<cyclus::Material::Ptr> > spent;
+  // total quantity of spent fuel held for each outcommod.
+  std::map<std::string, double> spent_qty_;
+  // total number of assemblies held across all spent outcommods.
+  int n_spent_;
 
 
   // should be hidden in ui (internal only). True if fuel has already been
@@ -454,13 +823,63 @@ class Reactor : public cyclus::Facility,
 
   // This variable should be hidden/unavailable in ui.  Maps resource object
   // id's to the index for the incommod through which they were received.
+  // This is only populated while persisting/restoring the reactor - assem_index_
+  // holds the working copy.
   #pragma cyclus var {"default": {}, "doc": "This should NEVER be set manually", \
                       "internal": True \
   }
   std::map<int, int> res_indexes;
 
-  // populated lazily and no need to persist.
-  std::set<std::string> uniq_outcommods_;
+  #pragma cyclus var {"default": 0, "internal": True, \
+                      "doc": "Number of time steps the core has operated for. " \
+                             "Only tracked if any fuel has a burnup table."}
+  int op_steps;
+
+  #pragma cyclus var {"default": {}, "internal": True, \
+                      "doc": "Maps resource object ids of core assemblies to " \
+                             "op_steps when they entered the core. Only " \
+                             "tracked if any fuel has a burnup table."}
+  std::map<int, int> load_steps;
+
+  #pragma cyclus var {"default": [], "internal": True, \
+                      "doc": "Names of the recipes registered for " \
+                             "interpolated burnup compositions."}
+  std::set<std::string> burnup_comp_recipes;
+
+  // open power (first) and side product runs when record_intervals is set.
+  // A start time of -1 means no run is open.
+  #pragma cyclus var {"default": [], "internal": True, \
+                      "doc": "First time step of each open output interval."}
+  std::vector<int> interval_starts;
+
+  #pragma cyclus var {"default": [], "internal": True, \
+                      "doc": "Last time step of each open output interval."}
+  std::vector<int> interval_ends;
+
+  #pragma cyclus var {"default": [], "internal": True, \
+                      "doc": "Value of each open output interval."}
+  std::vector<double> interval_values;
+
+  // Maps resource object id's of the assemblies currently held to the index
+  // for the incommod through which they were received.
+  AssemblyIndex assem_index_;
+
+  // fuel specifications with resolved recipes (same order as
+  // fuel_incommods) - rebuilt on entering the simulation and updated on
+  // preference/recipe changes.
+  std::vector<FuelSlot> fuel_slots_;
+
+  // preference and recipe changes sorted by time - compiled from the
+  // *_change_* state vars on entering the simulation.
+  std::vector<FuelChange> fuel_changes_;
+  // position in fuel_changes_ of the next change to apply.
+  int next_fuel_change_;
+
+
+  // interpolated discharge compositions keyed by fuel index and operating
+  // time steps, shared by all assemblies with the same burnup.  Each is also
+  // registered as a recipe named in burnup_comp_recipes.
+  std::map<std::pair<int, int>, cyclus::Composition::Ptr> burnup_comps_;
 };
 
 } // namespace cycamore
@@ -0,0 +1,557 @@
+#include "reactor_fleet.h"
+
+#include <algorithm>
+
+using cyclus::Material;
+using cyclus::toolkit::MatVec;
+using cyclus::toolkit::ResBuf;
+using cyclus::ValueError;
+using cyclus::Request;
+
+namespace cycamore {
+
+typedef std::map<std::string, ResBuf<Material> > PoolMap;
+
+ReactorFleet::ReactorFleet(cyclus::Context* ctx)
+    : cyclus::Facility(ctx),
+      n_units(1),
+      n_assem_batch(0),
+      assem_size(0),
+      n_assem_core(0),
+      n_assem_spent(0),
+      n_assem_fresh(0),
+      cycle_time(0),
+      refuel_time(0),
+      power_cap(0),
+      power_name("power") {}
+
+#pragma cyclus def clone cycamore::ReactorFleet
+
+#pragma cyclus def schema cycamore::ReactorFleet
+
+#pragma cyclus def annotations cycamore::ReactorFleet
+
+#pragma cyclus def infiletodb cycamore::ReactorFleet
+
+#pragma cyclus def snapshot cycamore::ReactorFleet
+
+// the snapshotinv and initinv pragmas are ommitted and the functions are
+// written manually in order to handle the pooled inventories.  The inventory
+// names are prefixed so fresh, core and spent pools on the same commodity do
+// not clash.
+cyclus::Inventories ReactorFleet::SnapshotInv() {
+  cyclus::Inventories invs;
+  PoolMap* pools[] = {&fresh_, &core_, &spent_};
+  std::string prefixes[] = {"fresh:", "core:", "spent:"};
+  for (int i = 0; i < 3; i++) {
+    PoolMap::iterator it;
+    for (it = pools[i]->begin(); it != pools[i]->end(); ++it) {
+      std::string name = prefixes[i] + it->first;
+      invs[name] = it->second.PopNRes(it->second.count());
+      it->second.Push(invs[name]);
+    }
+  }
+  return invs;
+}
+
+void ReactorFleet::InitInv(cyclus::Inventories& inv) {
+  PoolMap* pools[] = {&fresh_, &core_, &spent_};
+  std::string prefixes[] = {"fresh:", "core:", "spent:"};
+  cyclus::Inventories::iterator it;
+  for (it = inv.begin(); it != inv.end(); ++it) {
+    for (int i = 0; i < 3; i++) {
+      if (it->first.compare(0, prefixes[i].size(), prefixes[i]) == 0) {
+        std::string commod = it->first.substr(prefixes[i].size());
+        (*pools[i])[commod].Push(it->second);
+        break;
+      }
+    }
+  }
+}
+
+void ReactorFleet::InitFrom(ReactorFleet* m) {
+  #pragma cyclus impl initfromcopy cycamore::ReactorFleet
+  cyclus::toolkit::CommodityProducer::Copy(m);
+}
+
+void ReactorFleet::InitFrom(cyclus::QueryableBackend* b) {
+  #pragma cyclus impl initfromdb cycamore::ReactorFleet
+
+  namespace tk = cyclus::toolkit;
+  tk::CommodityProducer::Add(tk::Commodity(power_name),
+                             tk::CommodInfo(n_units * power_cap,
+                                            n_units * power_cap));
+}
+
+void ReactorFleet::EnterNotify() {
+  cyclus::Facility::EnterNotify();
+
+  if (fuel_prefs.size() == 0) {
+    for (int i = 0; i < fuel_outcommods.size(); i++) {
+      fuel_prefs.push_back(cyclus::kDefaultPref);
+    }
+  }
+
+  // input consistency checking:
+  std::stringstream ss;
+  CheckFuelSpecs(prototype(), fuel_incommods, fuel_inrecipes, fuel_outcommods,
+                 fuel_outrecipes, fuel_prefs, ss);
+  if (n_units < 1) {
+    ss << "prototype '" << prototype() << "' has " << n_units
+       << " n_units, expected at least 1\n";
+  }
+  if (ss.str().size() > 0) {
+    throw ValueError(ss.str());
+  }
+
+  fuel_slots_ = MakeFuelSlots(context(), fuel_incommods, fuel_inrecipes,
+                              fuel_outcommods, fuel_outrecipes, fuel_prefs);
+
+  // per-unit state is only empty on first entering the simulation - it is
+  // restored as-is on restart.
+  if (unit_cycle_step.empty()) {
+    unit_cycle_step.assign(n_units, 0);
+    unit_discharged.assign(n_units, 0);
+    unit_core.assign(n_units * n_assem_core, -1);
+    unit_n_core.assign(n_units, 0);
+    unit_n_burnt.assign(n_units, 0);
+    unit_fresh.assign(n_units * n_assem_fresh, -1);
+    unit_n_fresh.assign(n_units, 0);
+  }
+
+  InitializePosition();
+}
+
+bool ReactorFleet::CheckDecommissionCondition() {
+  for (int u = 0; u < n_units; u++) {
+    if (unit_n_core[u] > 0) {
+      return false;
+    }
+  }
+  PoolMap::iterator it;
+  for (it = spent_.begin(); it != spent_.end(); ++it) {
+    if (it->second.quantity() > cyclus::eps_rsrc()) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void ReactorFleet::Tick() {
+  if (retired()) {
+    bool first = context()->time() == exit_time() + 1;
+    for (int u = 0; u < n_units; u++) {
+      Record(u, kEventRetired);
+      if (first) {  // only need to transmute once
+        Transmute(u, core_cycle().NDecomTransmute(decom_transmute_all));
+      }
+      while (unit_n_core[u] > 0) {
+        if (!Discharge(u)) {
+          break;
+        }
+      }
+      // fresh fuel left over at retirement goes straight to spent fuel.
+      int n = static_cast<int>(std::max(
+          0.0, std::min<double>(unit_n_fresh[u], spent_room())));
+      if (n > 0) {
+        std::vector<int> counts(fuel_slots_.size(), 0);
+        for (int k = 0; k < n; k++) {
+          counts[unit_fresh[fresh_pos(u, k)]]++;
+        }
+        for (int s = 0; s < fuel_slots_.size(); s++) {
+          if (counts[s] > 0) {
+            spent_[fuel_slots_[s].outcommod].Push(
+                fresh_[fuel_slots_[s].incommod].Pop(counts[s] * assem_size,
+                                                    cyclus::eps_rsrc()));
+          }
+        }
+        std::copy(unit_fresh.begin() + fresh_pos(u, n),
+                  unit_fresh.begin() + fresh_pos(u, unit_n_fresh[u]),
+                  unit_fresh.begin() + fresh_pos(u, 0));
+        unit_n_fresh[u] -= n;
+      }
+    }
+    if (CheckDecommissionCondition()) {
+      context()->SchedDecom(this);
+    }
+    return;
+  }
+
+  CoreCycle cc = core_cycle();
+  for (int u = 0; u < n_units; u++) {
+    int& cycle_step = unit_cycle_step[u];
+    if (cc.Ends(cycle_step)) {
+      Transmute(u, n_assem_batch);
+      Record(u, kEventCycleEnd);
+    }
+    if (cc.Refueling(cycle_step) && !unit_discharged[u]) {
+      unit_discharged[u] = Discharge(u);
+    }
+    if (cc.Refueling(cycle_step)) {
+      Load(u);
+    }
+  }
+
+  PoolMap::iterator it;
+  for (it = spent_.begin(); it != spent_.end(); ++it) {
+    cyclus::toolkit::RecordTimeSeries<double>("supply"+it->first, this,
+                                              it->second.quantity());
+  }
+}
+
+void ReactorFleet::Tock() {
+  if (retired()) {
+    return;
+  }
+
+  CoreCycle cc = core_cycle();
+  int n_running = 0;
+  for (int u = 0; u < n_units; u++) {
+    int& cycle_step = unit_cycle_step[u];
+    if (cc.Restarts(cycle_step, unit_n_core[u], unit_discharged[u])) {
+      unit_discharged[u] = false;
+      cycle_step = 0;
+    }
+
+    if (cc.Starts(cycle_step, unit_n_core[u])) {
+      Record(u, kEventCycleStart);
+    }
+
+    double power = 0;
+    if (cc.Operating(cycle_step, unit_n_core[u])) {
+      power = power_cap;
+      n_running++;
+    }
+    context()
+        ->NewDatum("ReactorFleetPower")
+        ->AddVal("AgentId", id())
+        ->AddVal("Unit", u)
+        ->AddVal("Time", context()->time())
+        ->AddVal("Value", power)
+        ->Record();
+
+    cycle_step = cc.Advance(cycle_step, unit_n_core[u]);
+  }
+
+  cyclus::toolkit::RecordTimeSeries<cyclus::toolkit::POWER>(
+      this, n_running * power_cap);
+  cyclus::toolkit::RecordTimeSeries<double>("supplyPOWER", this,
+                                            n_running * power_cap);
+}
+
+std::set<cyclus::RequestPortfolio<Material>::Ptr>
+ReactorFleet::GetMatlRequests() {
+  using cyclus::RequestPortfolio;
+
+  std::set<RequestPortfolio<Material>::Ptr> ports;
+  if (retired()) {
+    return ports;
+  }
+
+  // each unit's order is reduced near retirement to what it can still burn.
+  CoreCycle cc = core_cycle();
+  int n_assem_order = 0;
+  for (int u = 0; u < n_units; u++) {
+    n_assem_order += cc.NOrder(unit_cycle_step[u], unit_n_core[u],
+                               unit_n_fresh[u], exit_time(),
+                               context()->time());
+  }
+  // whole assemblies from earlier partial fills are still waiting for units.
+  for (int s = 0; s < fuel_slots_.size(); s++) {
+    double qty = fresh_[fuel_slots_[s].incommod].quantity();
+    n_assem_order -= static_cast<int>(
+        std::floor((qty + cyclus::eps_rsrc()) / assem_size));
+  }
+  for (int u = 0; u < n_units; u++) {
+    n_assem_order += unit_n_fresh[u];
+  }
+  if (n_assem_order <= 0) {
+    return ports;
+  }
+
+  // one request per fuel for the whole fleet - partial fills are split into
+  // assemblies and handed out to units in order.
+  double qty = n_assem_order * assem_size;
+  RequestPortfolio<Material>::Ptr port(new RequestPortfolio<Material>());
+  std::vector<Request<Material>*> mreqs;
+  int max_index = 0;
+  for (int j = 0; j < fuel_slots_.size(); j++) {
+    const FuelSlot& slot = fuel_slots_[j];
+    Material::Ptr m = Material::CreateUntracked(qty, slot.inrecipe);
+    mreqs.push_back(port->AddRequest(m, this, slot.incommod, slot.pref));
+    if (slot.pref > fuel_slots_[max_index].pref) {
+      max_index = j;
+    }
+  }
+
+  cyclus::toolkit::RecordTimeSeries<double>(
+      "demand"+fuel_slots_[max_index].incommod, this, qty);
+
+  port->AddMutualReqs(mreqs);
+  ports.insert(port);
+  return ports;
+}
+
+void ReactorFleet::AcceptMatlTrades(const std::vector<
+    std::pair<cyclus::Trade<Material>, Material::Ptr> >& responses) {
+  std::vector<std::pair<cyclus::Trade<Material>,
+                        Material::Ptr> >::const_iterator trade;
+  for (trade = responses.begin(); trade != responses.end(); ++trade) {
+    fresh_[trade->first.request->commodity()].Push(trade->second);
+  }
+  AssignFresh();
+}
+
+void ReactorFleet::AssignFresh() {
+  int nslots = fuel_slots_.size();
+
+  // whole assemblies in each fresh pool not yet held for a unit
+  std::vector<int> avail(nslots, 0);
+  for (int s = 0; s < nslots; s++) {
+    double qty = fresh_[fuel_slots_[s].incommod].quantity();
+    avail[s] = static_cast<int>(
+        std::floor((qty + cyclus::eps_rsrc()) / assem_size));
+  }
+  for (int u = 0; u < n_units; u++) {
+    for (int k = 0; k < unit_n_fresh[u]; k++) {
+      avail[unit_fresh[fresh_pos(u, k)]]--;
+    }
+  }
+
+  int s = 0;
+  for (int u = 0; u < n_units; u++) {
+    std::vector<int> loaded(nslots, 0);
+    int nload = 0;
+    while (s < nslots) {
+      if (avail[s] <= 0) {
+        s++;
+        continue;
+      }
+      if (unit_n_core[u] < n_assem_core) {
+        unit_core[core_pos(u, unit_n_core[u]++)] = s;
+        loaded[s]++;
+        nload++;
+      } else if (unit_n_fresh[u] < n_assem_fresh) {
+        unit_fresh[fresh_pos(u, unit_n_fresh[u]++)] = s;
+      } else {
+        break;
+      }
+      avail[s]--;
+    }
+    if (nload > 0) {
+      MovePooled(loaded, fresh_, core_);
+      Record(u, kEventLoad, nload);
+    }
+  }
+}
+
+std::set<cyclus::BidPortfolio<Material>::Ptr> ReactorFleet::GetMatlBids(
+    cyclus::CommodMap<Material>::type& commod_requests) {
+  using cyclus::BidPortfolio;
+  std::set<BidPortfolio<Material>::Ptr> ports;
+
+  PoolMap::iterator it;
+  for (it = spent_.begin(); it != spent_.end(); ++it) {
+    std::string commod = it->first;
+    ResBuf<Material>& buf = it->second;
+    double avail = buf.quantity();
+    if (avail <= cyclus::eps_rsrc()) {
+      continue;
+    }
+    std::vector<Request<Material>*>& reqs = commod_requests[commod];
+    if (reqs.size() == 0) {
+      continue;
+    }
+
+    // the pool can hold several compositions (e.g. fuels sharing an
+    // outcommod) - each is bid and constrained separately, as the Reactor
+    // does with aggregate_bids.
+    std::vector<cyclus::Composition::Ptr> comps;
+    std::vector<double> qtys;
+    MatVec mats = buf.PopN(buf.count());
+    for (int k = 0; k < mats.size(); k++) {
+      int g = std::find(comps.begin(), comps.end(), mats[k]->comp()) -
+              comps.begin();
+      if (g == comps.size()) {
+        comps.push_back(mats[k]->comp());
+        qtys.push_back(0);
+      }
+      qtys[g] += mats[k]->quantity();
+    }
+    buf.Push(mats);
+
+    BidPortfolio<Material>::Ptr port(new BidPortfolio<Material>());
+    for (int g = 0; g < comps.size(); g++) {
+      for (int j = 0; j < reqs.size(); j++) {
+        Request<Material>* req = reqs[j];
+        double qty = std::min(qtys[g], req->target()->quantity());
+        port->AddBid(req, Material::CreateUntracked(qty, comps[g]), this);
+      }
+      cyclus::Converter<Material>::Ptr conv(new CompConverter(comps[g]));
+      cyclus::CapacityConstraint<Material> cc(qtys[g], conv);
+      port->AddConstraint(cc);
+    }
+    ports.insert(port);
+  }
+
+  return ports;
+}
+
+void ReactorFleet::GetMatlTrades(
+    const std::vector<cyclus::Trade<Material> >& trades,
+    std::vector<std::pair<cyclus::Trade<Material>, Material::Ptr> >&
+        responses) {
+  for (int i = 0; i < trades.size(); i++) {
+    std::string commod = trades[i].request->commodity();
+    Material::Ptr m = PopSpent(spent_[commod], trades[i].bid->offer()->comp(),
+                               trades[i].amt);
+    responses.push_back(std::make_pair(trades[i], m));
+  }
+}
+
+Material::Ptr ReactorFleet::PopSpent(ResBuf<Material>& buf,
+                                     cyclus::Composition::Ptr comp,
+                                     double qty) {
+  Material::Ptr popped;
+  MatVec mats = buf.PopN(buf.count());
+  for (int k = 0; k < mats.size(); k++) {
+    Material::Ptr m = mats[k];
+    if (qty > cyclus::eps_rsrc() && m->comp() == comp) {
+      Material::Ptr part = m;
+      if (m->quantity() > qty + cyclus::eps_rsrc()) {
+        part = m->ExtractQty(qty);
+      } else {
+        m.reset();
+      }
+      qty -= part->quantity();
+      if (popped) {
+        popped->Absorb(part);
+      } else {
+        popped = part;
+      }
+    }
+    if (m) {
+      buf.Push(m);
+    }
+  }
+  if (!popped) {
+    throw ValueError("cycamore::ReactorFleet - no spent fuel of the traded "
+                     "composition left for prototype " + prototype());
+  }
+  return popped;
+}
+
+int ReactorFleet::n_spent() {
+  double qty = 0;
+  PoolMap::iterator it;
+  for (it = spent_.begin(); it != spent_.end(); ++it) {
+    qty += it->second.quantity();
+  }
+  return static_cast<int>(ceil(qty / assem_size - cyclus::eps_rsrc()));
+}
+
+double ReactorFleet::spent_room() {
+  return static_cast<double>(n_units) * n_assem_spent - n_spent();
+}
+
+void ReactorFleet::Transmute(int u, int n) {
+  n = std::min(n, unit_n_core[u]);
+  unit_n_burnt[u] = std::max(unit_n_burnt[u], n);
+  Record(u, kEventTransmute, n);
+}
+
+bool ReactorFleet::Discharge(int u) {
+  int npop = core_cycle().NDischarge(unit_n_core[u]);
+  if (spent_room() < npop) {
+    Record(u, kEventDischargeFailed);
+    return false;  // not enough room in spent fuel storage
+  }
+
+  // oldest assemblies leave first - burnt ones are transmuted on the way.
+  int nslots = fuel_slots_.size();
+  std::vector<int> burnt(nslots, 0);
+  std::vector<int> unburnt(nslots, 0);
+  for (int k = 0; k < npop; k++) {
+    int s = unit_core[core_pos(u, k)];
+    if (k < unit_n_burnt[u]) {
+      burnt[s]++;
+    } else {
+      unburnt[s]++;
+    }
+  }
+  for (int s = 0; s < nslots; s++) {
+    const FuelSlot& slot = fuel_slots_[s];
+    int n = burnt[s] + unburnt[s];
+    if (n == 0) {
+      continue;
+    }
+    ResBuf<Material>& core = core_[slot.incommod];
+    ResBuf<Material>& spent = spent_[slot.outcommod];
+    if (burnt[s] > 0) {
+      Material::Ptr m = core.Pop(burnt[s] * assem_size, cyclus::eps_rsrc());
+      m->Transmute(slot.outrecipe);
+      spent.Push(m);
+    }
+    if (unburnt[s] > 0) {
+      spent.Push(core.Pop(unburnt[s] * assem_size, cyclus::eps_rsrc()));
+    }
+  }
+
+  std::copy(unit_core.begin() + core_pos(u, npop),
+            unit_core.begin() + core_pos(u, unit_n_core[u]),
+            unit_core.begin() + core_pos(u, 0));
+  unit_n_core[u] -= npop;
+  unit_n_burnt[u] = std::max(0, unit_n_burnt[u] - npop);
+  Record(u, kEventDischarge, npop);
+  return true;
+}
+
+void ReactorFleet::Load(int u) {
+  int n = std::min(n_assem_core - unit_n_core[u], unit_n_fresh[u]);
+  if (n == 0) {
+    return;
+  }
+
+  std::vector<int> counts(fuel_slots_.size(), 0);
+  for (int k = 0; k < n; k++) {
+    int s = unit_fresh[fresh_pos(u, k)];
+    unit_core[core_pos(u, unit_n_core[u]++)] = s;
+    counts[s]++;
+  }
+  std::copy(unit_fresh.begin() + fresh_pos(u, n),
+            unit_fresh.begin() + fresh_pos(u, unit_n_fresh[u]),
+            unit_fresh.begin() + fresh_pos(u, 0));
+  unit_n_fresh[u] -= n;
+
+  MovePooled(counts, fresh_, core_);
+  Record(u, kEventLoad, n);
+}
+
+void ReactorFleet::MovePooled(const std::vector<int>& counts, PoolMap& from,
+                              PoolMap& to) {
+  for (int s = 0; s < counts.size(); s++) {
+    if (counts[s] == 0) {
+      continue;
+    }
+    const std::string& commod = fuel_slots_[s].incommod;
+    to[commod].Push(from[commod].Pop(counts[s] * assem_size,
+                                     cyclus::eps_rsrc()));
+  }
+}
+
+void ReactorFleet::Record(int u, ReactorEvent event, int n_assem) {
+  context()
+      ->NewDatum("ReactorFleetEvents")
+      ->AddVal("AgentId", id())
+      ->AddVal("Unit", u)
+      ->AddVal("Time", context()->time())
+      ->AddVal("Event", static_cast<int>(event))
+      ->AddVal("NAssemblies", n_assem)
+      ->Record();
+}
+
+extern "C" cyclus::Agent* ConstructReactorFleet(cyclus::Context* ctx) {
+  return new ReactorFleet(ctx);
+}
+
+}  // namespace cycamore
@@ -0,0 +1,337 @@
+#ifndef CYCAMORE_SRC_REACTOR_FLEET_H_
+#define CYCAMORE_SRC_REACTOR_FLEET_H_
+
+#include "cyclus.h"
+#include "cycamore_version.h"
+#include "reactor.h"
+
+namespace cycamore {
+
+/// ReactorFleet models a number of identical reactors as a single agent.  Each
+/// unit follows the same cycle as a cycamore Reactor - at the end of every
+/// cycle a batch of n_assem_batch assemblies is transmuted and discharged, and
+/// the next cycle starts once the refueling period is over and the core is
+/// full again.
+///
+/// Per-unit state (cycle step, core and fresh fuel assemblies) is held as
+/// flat arrays of fuel indices rather than as material, while the material
+/// itself is pooled per commodity for the whole fleet.  The fleet makes a
+/// single pooled request for the fresh fuel needed by all of its units and
+/// offers its pooled spent fuel with one bid per request and spent fuel
+/// composition, so the exchange sees one agent instead of n_units.  The cycle
+/// logic of each unit is the CoreCycle shared with the Reactor.  Received fuel is split into assemblies
+/// and handed out to units in order.
+///
+/// Because material is pooled, spent fuel is traded in bulk rather than as
+/// discrete assemblies and the spent fuel storage limit applies to the fleet
+/// as a whole (n_units * n_assem_spent assemblies).  Preference and recipe
+/// changes and side products are not supported.  Power is recorded both for
+/// the fleet (TimeSeriesPower) and per unit (ReactorFleetPower), and events
+/// are recorded per unit in the ReactorFleetEvents table using the same
+/// ReactorEvent codes as the Reactor.
+class ReactorFleet : public cyclus::Facility,
+  public cyclus::toolkit::CommodityProducer,
+  public cyclus::toolkit::Position {
+#pragma cyclus note { \
+"niche": "reactor", \
+"doc": \
+  "ReactorFleet models a number of identical reactors as a single agent.  Each" \
+  " unit follows the same cycle as a cycamore Reactor - at the end of every" \
+  " cycle a batch of n_assem_batch assemblies is transmuted and discharged," \
+  " and the next cycle starts once the refueling period is over and the core" \
+  " is full again." \
+  "\n\n" \
+  "Per-unit state is held as flat arrays while material is pooled per" \
+  " commodity for the whole fleet.  The fleet makes a single pooled request for" \
+  " the fresh fuel needed by all of its units and offers its pooled spent fuel" \
+  " with one bid per request and spent fuel composition.  Received fuel is" \
+  " split into assemblies and handed out to units in order." \
+  "\n\n" \
+  "Because material is pooled, spent fuel is traded in bulk rather than as" \
+  " discrete assemblies and the spent fuel storage limit applies to the fleet" \
+  " as a whole (n_units * n_assem_spent assemblies).  Preference and recipe" \
+  " changes and side products are not supported.  Power is recorded both for" \
+  " the fleet (TimeSeriesPower) and per unit (ReactorFleetPower), and events" \
+  " are recorded per unit in the ReactorFleetEvents table." \
+  "", \
+}
+
+ public:
+  ReactorFleet(cyclus::Context* ctx);
+  virtual ~ReactorFleet(){};
+
+  virtual std::string version() { return CYCAMORE_VERSION; }
+
+  virtual void Tick();
+  virtual void Tock();
+  virtual void EnterNotify();
+  virtual bool CheckDecommissionCondition();
+
+  virtual void AcceptMatlTrades(const std::vector<std::pair<
+      cyclus::Trade<cyclus::Material>, cyclus::Material::Ptr> >& responses);
+
+  virtual std::set<cyclus::RequestPortfolio<cyclus::Material>::Ptr>
+  GetMatlRequests();
+
+  virtual std::set<cyclus::BidPortfolio<cyclus::Material>::Ptr> GetMatlBids(
+      cyclus::CommodMap<cyclus::Material>::type& commod_requests);
+
+  virtual void GetMatlTrades(
+      const std::vector<cyclus::Trade<cyclus::Material> >& trades,
+      std::vector<std::pair<cyclus::Trade<cyclus::Material>,
+                            cyclus::Material::Ptr> >& responses);
+
+  #pragma cyclus decl
+
+ private:
+  // Code Injection:
+  #include "toolkit/position.cycpp.h"
+
+  bool retired() {
+    return exit_time() != -1 && context()->time() > exit_time();
+  }
+
+  /// Returns the cycle logic shared by all units' cores.
+  CoreCycle core_cycle() const {
+    return CoreCycle(cycle_time, refuel_time, n_assem_core, n_assem_batch,
+                     n_assem_fresh);
+  }
+
+  /// Returns the position in unit_core of unit u's k-th oldest assembly.
+  int core_pos(int u, int k) { return u * n_assem_core + k; }
+
+  /// Returns the position in unit_fresh of unit u's k-th oldest assembly.
+  int fresh_pos(int u, int k) { return u * n_assem_fresh + k; }
+
+  /// Returns the number of (possibly partial) spent assemblies held.
+  int n_spent();
+
+  /// Returns the number of assemblies that still fit in the fleet's spent
+  /// fuel storage.  Computed in floating point since n_units * n_assem_spent
+  /// overflows an int for the default n_assem_spent.
+  double spent_room();
+
+  /// Removes and returns qty of spent fuel with the given composition from
+  /// the given pool, oldest first.
+  cyclus::Material::Ptr PopSpent(cyclus::toolkit::ResBuf<cyclus::Material>& buf,
+                                 cyclus::Composition::Ptr comp, double qty);
+
+  /// Hands out whole assemblies of received fresh fuel that are not yet
+  /// assigned to a unit - to unit cores first, then fresh fuel inventories.
+  void AssignFresh();
+
+  /// Marks the oldest n assemblies in unit u's core as burnt.
+  void Transmute(int u, int n);
+
+  /// Discharges a batch from unit u's core if there is room in the spent
+  /// fuel inventory.  Returns true if a batch was successfully discharged.
+  bool Discharge(int u);
+
+  /// Tops up unit u's core from its fresh fuel inventory.
+  void Load(int u);
+
+  /// Moves n assemblies of each fuel slot (counts) from the from pools to
+  /// the to pools.
+  void MovePooled(const std::vector<int>& counts,
+                  std::map<std::string,
+                           cyclus::toolkit::ResBuf<cyclus::Material> >& from,
+                  std::map<std::string,
+                           cyclus::toolkit::ResBuf<cyclus::Material> >& to);
+
+  /// Records an event for unit u to the output db.
+  void Record(int u, ReactorEvent event, int n_assem = 0);
+
+  /////// fuel specifications /////////
+  #pragma cyclus var { \
+    "uitype": ["oneormore", "incommodity"], \
+    "uilabel": "Fresh Fuel Commodity List", \
+    "doc": "Ordered list of input commodities on which to requesting fuel.", \
+  }
+  std::vector<std::string> fuel_incommods;
+
+  #pragma cyclus var { \
+    "uitype": ["oneormore", "inrecipe"], \
+    "uilabel": "Fresh Fuel Recipe List", \
+    "doc": "Fresh fuel recipes to request for each of the given fuel input " \
+           "commodities (same order).", \
+  }
+  std::vector<std::string> fuel_inrecipes;
+
+  #pragma cyclus var { \
+    "default": [], \
+    "uilabel": "Fresh Fuel Preference List", \
+    "doc": "The preference for each type of fresh fuel requested corresponding"\
+           " to each input commodity (same order).  If no preferences are " \
+           "specified, 1.0 is used for all fuel " \
+           "requests (default).", \
+  }
+  std::vector<double> fuel_prefs;
+
+  #pragma cyclus var { \
+    "uitype": ["oneormore", "outcommodity"], \
+    "uilabel": "Spent Fuel Commodity List", \
+    "doc": "Output commodities on which to offer spent fuel originally " \
+           "received as each particular input commodity (same order)." \
+  }
+  std::vector<std::string> fuel_outcommods;
+
+  #pragma cyclus var {           \
+    "uitype": ["oneormore", "outrecipe"], \
+    "uilabel": "Spent Fuel Recipe List", \
+    "doc": "Spent fuel recipes corresponding to the given fuel input " \
+           "commodities (same order)." \
+           " Fuel received via a particular input commodity is transmuted to " \
+           "the recipe specified here after being burned during a cycle.", \
+  }
+  std::vector<std::string> fuel_outrecipes;
+
+  //////////// fleet, inventory and core params ////////////
+  #pragma cyclus var { \
+    "default": 1, \
+    "uilabel": "Number of Units", \
+    "doc": "Number of identical reactor units in the fleet.", \
+  }
+  int n_units;
+
+  #pragma cyclus var { \
+    "doc": "Mass (kg) of a single assembly.", \
+    "uilabel": "Assembly Mass", \
+    "uitype": "range", \
+    "range": [1.0, 1e5], \
+    "units": "kg", \
+  }
+  double assem_size;
+
+  #pragma cyclus var { \
+    "uilabel": "Number of Assemblies per Batch", \
+    "doc": "Number of assemblies that constitute a single batch of a unit.  " \
+           "This is the number of assemblies discharged from each unit's " \
+           "core fully burned each cycle.", \
+  }
+  int n_assem_batch;
+
+  #pragma cyclus var { \
+    "default": 3, \
+    "uilabel": "Number of Assemblies in Core", \
+    "uitype": "range", \
+    "range": [1,3], \
+    "doc": "Number of assemblies that constitute a full core of a unit.", \
+  }
+  int n_assem_core;
+
+  #pragma cyclus var { \
+    "default": 0, \
+    "uilabel": "Minimum Fresh Fuel Inventory", \
+    "uitype": "range", \
+    "range": [0,3], \
+    "units": "assemblies", \
+    "doc": "Number of fresh fuel assemblies each unit keeps on-hand if " \
+           "possible.", \
+  }
+  int n_assem_fresh;
+
+  #pragma cyclus var { \
+    "default": 1000000000, \
+    "uilabel": "Maximum Spent Fuel Inventory", \
+    "uitype": "range", \
+    "range": [0, 1000000000], \
+    "units": "assemblies", \
+    "doc": "Number of spent fuel assemblies per unit that can be stored " \
+           "on-site before reactor operation stalls.  The limit applies to " \
+           "the fleet's pooled spent fuel as a whole.", \
+  }
+  int n_assem_spent;
+
+  ///////// cycle params ///////////
+  #pragma cyclus var { \
+    "default": 18, \
+    "doc": "The duration of a full operational cycle (excluding refueling " \
+           "time) in time steps.", \
+    "uilabel": "Cycle Length", \
+    "units": "time steps", \
+  }
+  int cycle_time;
+
+  #pragma cyclus var { \
+    "default": 1, \
+    "doc": "The duration of a full refueling period - the minimum time between"\
+           " the end of a cycle and the start of the next cycle.", \
+    "uilabel": "Refueling Outage Duration", \
+    "units": "time steps", \
+  }
+  int refuel_time;
+
+  //////////// power params ////////////
+  #pragma cyclus var { \
+    "default": 0, \
+    "doc": "Amount of electrical power each unit produces when operating " \
+           "normally.", \
+    "uilabel": "Nominal Unit Power", \
+    "uitype": "range", \
+    "range": [0.0, 2000.00],  \
+    "units": "MWe", \
+  }
+  double power_cap;
+
+  #pragma cyclus var { \
+    "default": "power", \
+    "uilabel": "Power Commodity Name", \
+    "doc": "The name of the 'power' commodity used in conjunction with a " \
+           "deployment curve.", \
+  }
+  std::string power_name;
+
+  /////////// Decommission transmutation behavior ///////////
+  #pragma cyclus var {"default": 0, \
+                      "uilabel": "Boolean for transmutation behavior upon decommissioning.", \
+                      "doc": "If true, the archetype transmutes all assemblies upon decommissioning " \
+                             "If false, the archetype only transmutes half.", \
+  }
+  bool decom_transmute_all;
+
+  /////////// per-unit state ///////////
+  #pragma cyclus var {"default": [], "internal": True, \
+                      "doc": "Number of time steps since the start of each unit's last cycle."}
+  std::vector<int> unit_cycle_step;
+
+  #pragma cyclus var {"default": [], "internal": True, \
+                      "doc": "1 if each unit has discharged its batch since its last cycle ended."}
+  std::vector<int> unit_discharged;
+
+  #pragma cyclus var {"default": [], "internal": True, \
+                      "doc": "Fuel indices of each unit's core assemblies, oldest first " \
+                             "(n_assem_core entries per unit)."}
+  std::vector<int> unit_core;
+
+  #pragma cyclus var {"default": [], "internal": True, \
+                      "doc": "Number of assemblies in each unit's core."}
+  std::vector<int> unit_n_core;
+
+  #pragma cyclus var {"default": [], "internal": True, \
+                      "doc": "Number of the oldest assemblies in each unit's core that are burnt."}
+  std::vector<int> unit_n_burnt;
+
+  #pragma cyclus var {"default": [], "internal": True, \
+                      "doc": "Fuel indices of each unit's fresh assemblies, oldest first " \
+                             "(n_assem_fresh entries per unit)."}
+  std::vector<int> unit_fresh;
+
+  #pragma cyclus var {"default": [], "internal": True, \
+                      "doc": "Number of fresh assemblies held for each unit."}
+  std::vector<int> unit_n_fresh;
+
+  // pooled material for the whole fleet - fresh and core fuel keyed by
+  // incommod, spent fuel keyed by outcommod.  These are persisted through
+  // SnapshotInv/InitInv.
+  std::map<std::string, cyclus::toolkit::ResBuf<cyclus::Material> > fresh_;
+  std::map<std::string, cyclus::toolkit::ResBuf<cyclus::Material> > core_;
+  std::map<std::string, cyclus::toolkit::ResBuf<cyclus::Material> > spent_;
+
+  // fuel specifications with resolved recipes (same order as
+  // fuel_incommods) - rebuilt on entering the simulation.
+  std::vector<FuelSlot> fuel_slots_;
+};
+
+} // namespace cycamore
+
+#endif  // CYCAMORE_SRC_REACTOR_FLEET_H_
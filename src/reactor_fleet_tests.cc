@@ -0,0 +1,245 @@
+#include "reactor_fleet.h"
+
+#include <gtest/gtest.h>
+
+#include "cyclus.h"
+
+using pyne::nucname::id;
+using cyclus::Composition;
+using cyclus::Material;
+using cyclus::QueryResult;
+using cyclus::Cond;
+
+namespace cycamore {
+namespace reactorfleettests {
+
+Composition::Ptr c_uox() {
+  cyclus::CompMap m;
+  m[id("u235")] = 0.04;
+  m[id("u238")] = 0.96;
+  return Composition::CreateFromMass(m);
+};
+
+Composition::Ptr c_spentuox() {
+  cyclus::CompMap m;
+  m[id("u235")] =  .8;
+  m[id("u238")] =  100;
+  m[id("pu239")] = 1;
+  return Composition::CreateFromMass(m);
+};
+
+Composition::Ptr c_mox() {
+  cyclus::CompMap m;
+  m[id("u235")] = .7;
+  m[id("u238")] = 100;
+  m[id("pu239")] = 3.3;
+  return Composition::CreateFromMass(m);
+};
+
+Composition::Ptr c_spentmox() {
+  cyclus::CompMap m;
+  m[id("u235")] = .7;
+  m[id("u238")] = 100;
+  m[id("pu239")] = .9;
+  return Composition::CreateFromMass(m);
+};
+
+// Tests that the fleet orders fuel for all of its units with a single pooled
+// trade per time step and runs every unit with no delay.
+TEST(ReactorFleetTests, JustInTimeOrdering) {
+  std::string config =
+     "  <fuel_inrecipes>  <val>lwr_fresh</val>  </fuel_inrecipes>  "
+     "  <fuel_outrecipes> <val>lwr_spent</val>  </fuel_outrecipes>  "
+     "  <fuel_incommods>  <val>enriched_u</val> </fuel_incommods>  "
+     "  <fuel_outcommods> <val>waste</val>      </fuel_outcommods>  "
+     "  <fuel_prefs>      <val>1.0</val>        </fuel_prefs>  "
+     ""
+     "  <n_units>4</n_units>  "
+     "  <cycle_time>1</cycle_time>  "
+     "  <refuel_time>0</refuel_time>  "
+     "  <assem_size>300</assem_size>  "
+     "  <n_assem_core>1</n_assem_core>  "
+     "  <n_assem_batch>1</n_assem_batch>  "
+     "  <power_cap>100</power_cap>  ";
+
+  int simdur = 10;
+  cyclus::MockSim sim(cyclus::AgentSpec(":cycamore:ReactorFleet"), config, simdur);
+  sim.AddSource("enriched_u").Finalize();
+  sim.AddRecipe("lwr_fresh", c_uox());
+  sim.AddRecipe("lwr_spent", c_spentuox());
+  int id = sim.Run();
+
+  QueryResult qr = sim.db().Query("Transactions", NULL);
+  EXPECT_EQ(simdur, qr.rows.size());
+
+  std::vector<Cond> conds;
+  conds.push_back(Cond("Value", "==", 100.0));
+  qr = sim.db().Query("ReactorFleetPower", &conds);
+  EXPECT_EQ(4 * simdur, qr.rows.size());
+
+  conds[0] = Cond("Value", "==", 400.0);
+  qr = sim.db().Query("TimeSeriesPower", &conds);
+  EXPECT_EQ(simdur, qr.rows.size());
+}
+
+// Tests that spent fuel discharged by all units is transmuted and traded away
+// from the pooled inventory.
+TEST(ReactorFleetTests, SpentFuelTrading) {
+  std::string config =
+     "  <fuel_inrecipes>  <val>uox</val>      </fuel_inrecipes>  "
+     "  <fuel_outrecipes> <val>spentuox</val> </fuel_outrecipes>  "
+     "  <fuel_incommods>  <val>uox</val>      </fuel_incommods>  "
+     "  <fuel_outcommods> <val>waste</val>    </fuel_outcommods>  "
+     ""
+     "  <n_units>3</n_units>  "
+     "  <cycle_time>1</cycle_time>  "
+     "  <refuel_time>0</refuel_time>  "
+     "  <assem_size>1</assem_size>  "
+     "  <n_assem_core>3</n_assem_core>  "
+     "  <n_assem_batch>1</n_assem_batch>  ";
+
+  int simdur = 10;
+  cyclus::MockSim sim(cyclus::AgentSpec(":cycamore:ReactorFleet"), config, simdur);
+  sim.AddSource("uox").Finalize();
+  sim.AddSink("waste").Finalize();
+  sim.AddRecipe("uox", c_uox());
+  Composition::Ptr spentuox = c_spentuox();
+  sim.AddRecipe("spentuox", spentuox);
+  int id = sim.Run();
+
+  std::vector<Cond> conds;
+  conds.push_back(Cond("SenderId", "==", id));
+  conds.push_back(Cond("Commodity", "==", std::string("waste")));
+  QueryResult qr = sim.db().Query("Transactions", &conds);
+  ASSERT_EQ(simdur - 1, qr.rows.size());
+  for (int i = 0; i < qr.rows.size(); i++) {
+    Material::Ptr m = sim.GetMaterial(qr.GetVal<int>("ResourceId", i));
+    EXPECT_DOUBLE_EQ(3, m->quantity());
+    EXPECT_EQ(spentuox->id(), m->comp()->id());
+  }
+}
+
+// Tests that the default spent fuel storage limit does not overflow for
+// fleets of several units - every unit discharges every cycle.
+TEST(ReactorFleetTests, DefaultSpentStorage) {
+  std::string config =
+     "  <fuel_inrecipes>  <val>uox</val>      </fuel_inrecipes>  "
+     "  <fuel_outrecipes> <val>spentuox</val> </fuel_outrecipes>  "
+     "  <fuel_incommods>  <val>uox</val>      </fuel_incommods>  "
+     "  <fuel_outcommods> <val>waste</val>    </fuel_outcommods>  "
+     ""
+     "  <n_units>5</n_units>  "
+     "  <cycle_time>1</cycle_time>  "
+     "  <refuel_time>0</refuel_time>  "
+     "  <assem_size>1</assem_size>  "
+     "  <n_assem_core>1</n_assem_core>  "
+     "  <n_assem_batch>1</n_assem_batch>  ";
+
+  int simdur = 5;
+  cyclus::MockSim sim(cyclus::AgentSpec(":cycamore:ReactorFleet"), config, simdur);
+  sim.AddSource("uox").Finalize();
+  sim.AddRecipe("uox", c_uox());
+  sim.AddRecipe("spentuox", c_spentuox());
+  int id = sim.Run();
+
+  std::vector<Cond> conds;
+  conds.push_back(Cond("Event", "==", static_cast<int>(kEventDischarge)));
+  QueryResult qr = sim.db().Query("ReactorFleetEvents", &conds);
+  EXPECT_EQ(5 * (simdur - 1), qr.rows.size());
+
+  conds[0] = Cond("Event", "==", static_cast<int>(kEventDischargeFailed));
+  EXPECT_THROW(sim.db().Query("ReactorFleetEvents", &conds), std::exception);
+}
+
+// Tests that pooled spent fuel of different compositions on the same
+// commodity is offered and traded per composition.
+TEST(ReactorFleetTests, MixedSpentFuel) {
+  std::string config =
+     "  <fuel_inrecipes>  <val>uox</val>      <val>mox</val>      </fuel_inrecipes>  "
+     "  <fuel_outrecipes> <val>spentuox</val> <val>spentmox</val> </fuel_outrecipes>  "
+     "  <fuel_incommods>  <val>uox</val>      <val>mox</val>      </fuel_incommods>  "
+     "  <fuel_outcommods> <val>waste</val>    <val>waste</val>    </fuel_outcommods>  "
+     ""
+     "  <n_units>2</n_units>  "
+     "  <cycle_time>1</cycle_time>  "
+     "  <refuel_time>0</refuel_time>  "
+     "  <assem_size>1</assem_size>  "
+     "  <n_assem_core>1</n_assem_core>  "
+     "  <n_assem_batch>1</n_assem_batch>  ";
+
+  int simdur = 6;
+  cyclus::MockSim sim(cyclus::AgentSpec(":cycamore:ReactorFleet"), config, simdur);
+  sim.AddSource("uox").capacity(1).Finalize();
+  sim.AddSource("mox").capacity(1).Finalize();
+  sim.AddSink("waste").Finalize();
+  sim.AddRecipe("uox", c_uox());
+  sim.AddRecipe("mox", c_mox());
+  Composition::Ptr spentuox = c_spentuox();
+  sim.AddRecipe("spentuox", spentuox);
+  Composition::Ptr spentmox = c_spentmox();
+  sim.AddRecipe("spentmox", spentmox);
+  int id = sim.Run();
+
+  std::vector<Cond> conds;
+  conds.push_back(Cond("SenderId", "==", id));
+  conds.push_back(Cond("Commodity", "==", std::string("waste")));
+  QueryResult qr = sim.db().Query("Transactions", &conds);
+  ASSERT_EQ(2 * (simdur - 1), qr.rows.size());
+
+  int nuox = 0;
+  int nmox = 0;
+  for (int i = 0; i < qr.rows.size(); i++) {
+    Material::Ptr m = sim.GetMaterial(qr.GetVal<int>("ResourceId", i));
+    EXPECT_DOUBLE_EQ(1, m->quantity());
+    if (m->comp()->id() == spentuox->id()) {
+      nuox++;
+    } else if (m->comp()->id() == spentmox->id()) {
+      nmox++;
+    }
+  }
+  EXPECT_EQ(simdur - 1, nuox);
+  EXPECT_EQ(simdur - 1, nmox);
+}
+
+// Tests that each unit follows the reactor cycle and shuts down with the
+// fleet at the end of its lifetime.
+TEST(ReactorFleetTests, DecomTimes) {
+  std::string config =
+     "  <fuel_inrecipes>  <val>uox</val>      </fuel_inrecipes>  "
+     "  <fuel_outrecipes> <val>spentuox</val> </fuel_outrecipes>  "
+     "  <fuel_incommods>  <val>uox</val>      </fuel_incommods>  "
+     "  <fuel_outcommods> <val>waste</val>    </fuel_outcommods>  "
+     ""
+     "  <n_units>2</n_units>  "
+     "  <cycle_time>2</cycle_time>  "
+     "  <refuel_time>2</refuel_time>  "
+     "  <assem_size>1</assem_size>  "
+     "  <n_assem_core>3</n_assem_core>  "
+     "  <power_cap>1000</power_cap>  "
+     "  <n_assem_batch>1</n_assem_batch>  ";
+
+  int simdur = 12;
+  int lifetime = 7;
+  cyclus::MockSim sim(cyclus::AgentSpec(":cycamore:ReactorFleet"), config, simdur, lifetime);
+  sim.AddSource("uox").Finalize();
+  sim.AddRecipe("uox", c_uox());
+  sim.AddRecipe("spentuox", c_spentuox());
+  int id = sim.Run();
+
+  // each unit operates for 2+2 months and is shut down for 2+1
+  std::vector<Cond> conds;
+  conds.push_back(Cond("Value", "==", 1000.0));
+  QueryResult qr = sim.db().Query("ReactorFleetPower", &conds);
+  EXPECT_EQ(2 * 4, qr.rows.size());
+
+  conds[0] = Cond("Value", "==", 0.0);
+  qr = sim.db().Query("ReactorFleetPower", &conds);
+  EXPECT_EQ(2 * 3, qr.rows.size());
+
+  conds[0] = Cond("Event", "==", static_cast<int>(kEventCycleStart));
+  qr = sim.db().Query("ReactorFleetEvents", &conds);
+  EXPECT_EQ(2 * 2, qr.rows.size());
+}
+
+}  // namespace reactorfleettests
+}  // namespace cycamore
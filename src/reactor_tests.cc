@@ -1,5 +1,8 @@
+#include "reactor.h"
+
 #include <gtest/gtest.h>
 
+#include <chrono>
 #include <sstream>
 
 #include "cyclus.h"
@@ -107,6 +110,46 @@ TEST(ReactorTests, BatchSizes) {
   EXPECT_EQ(7+3*(simdur-1), qr.rows.size());
 }
 
+// tests that batch request mode orders each batch as a single trade and
+// splits it into individually tracked assemblies.
+TEST(ReactorTests, BatchRequests) {
+  std::string config =
+     "  <fuel_inrecipes>  <val>uox</val>      </fuel_inrecipes>  "
+     "  <fuel_outrecipes> <val>spentuox</val> </fuel_outrecipes>  "
+     "  <fuel_incommods>  <val>uox</val>      </fuel_incommods>  "
+     "  <fuel_outcommods> <val>waste</val>    </fuel_outcommods>  "
+     ""
+     "  <cycle_time>1</cycle_time>  "
+     "  <refuel_time>0</refuel_time>  "
+     "  <assem_size>1</assem_size>  "
+     "  <n_assem_core>7</n_assem_core>  "
+     "  <n_assem_batch>3</n_assem_batch>  "
+     "  <batch_requests>1</batch_requests>  ";
+
+  int simdur = 50;
+  cyclus::MockSim sim(cyclus::AgentSpec(":cycamore:Reactor"), config, simdur);
+  sim.AddSource("uox").Finalize();
+  sim.AddSink("waste").Finalize();
+  sim.AddRecipe("uox", c_uox());
+  sim.AddRecipe("spentuox", c_spentuox());
+  int id = sim.Run();
+
+  std::vector<Cond> conds;
+  conds.push_back(Cond("Commodity", "==", std::string("uox")));
+  QueryResult qr = sim.db().Query("Transactions", &conds);
+  // one trade for the initial core and one per time step for each new batch
+  EXPECT_EQ(simdur, qr.rows.size());
+
+  conds[0] = Cond("Commodity", "==", std::string("waste"));
+  qr = sim.db().Query("Transactions", &conds);
+  // spent fuel still leaves the reactor one assembly at a time
+  EXPECT_EQ(3*(simdur-1), qr.rows.size());
+  for (int i = 0; i < qr.rows.size(); i++) {
+    Material::Ptr m = sim.GetMaterial(qr.GetVal<int>("ResourceId", i));
+    EXPECT_DOUBLE_EQ(1, m->quantity());
+  }
+}
+
 // tests that the refueling period between cycle end and start of the next
 // cycle is honored.
 TEST(ReactorTests, RefuelTimes) {
@@ -418,6 +461,103 @@ TEST(ReactorTests, DischargedFuelTransmute) {
   EXPECT_TRUE(mq.mass(942390000) > 0) << "transmuted spent fuel doesn't have Pu239";
 }
 
+// tests that fuel with a burnup table is discharged as a composition
+// interpolated from the time it spent operating in the core, and that
+// assemblies with the same burnup share one composition.
+TEST(ReactorTests, BurnupRecipes) {
+  std::string config =
+     "  <fuel_inrecipes>  <val>uox</val>      </fuel_inrecipes>  "
+     "  <fuel_outrecipes> <val>spentuox</val> </fuel_outrecipes>  "
+     "  <fuel_incommods>  <val>uox</val>      </fuel_incommods>  "
+     "  <fuel_outcommods> <val>waste</val>    </fuel_outcommods>  "
+     ""
+     "  <burnup_commods> <val>uox</val>   <val>uox</val>   </burnup_commods>  "
+     "  <burnup_times>   <val>1</val>     <val>3</val>     </burnup_times>  "
+     "  <burnup_recipes> <val>low</val>   <val>high</val>  </burnup_recipes>  "
+     ""
+     "  <cycle_time>1</cycle_time>  "
+     "  <refuel_time>0</refuel_time>  "
+     "  <assem_size>1</assem_size>  "
+     "  <n_assem_core>2</n_assem_core>  "
+     "  <n_assem_batch>1</n_assem_batch>  ";
+
+  cyclus::CompMap low;
+  low[id("u235")] = 1;
+  low[id("u238")] = 99;
+  cyclus::CompMap high;
+  high[id("u235")] = 3;
+  high[id("u238")] = 97;
+  Composition::Ptr c_low = Composition::CreateFromMass(low);
+
+  int simdur = 8;
+  cyclus::MockSim sim(cyclus::AgentSpec(":cycamore:Reactor"), config, simdur);
+  sim.AddSource("uox").Finalize();
+  sim.AddSink("waste").Finalize();
+  sim.AddRecipe("uox", c_uox());
+  sim.AddRecipe("spentuox", c_spentuox());
+  sim.AddRecipe("low", c_low);
+  sim.AddRecipe("high", Composition::CreateFromMass(high));
+  int id = sim.Run();
+
+  std::vector<Cond> conds;
+  conds.push_back(Cond("SenderId", "==", id));
+  QueryResult qr = sim.db().Query("Transactions", &conds);
+  ASSERT_EQ(simdur - 1, qr.rows.size());
+
+  int mixed_id = -1;
+  for (int i = 0; i < qr.rows.size(); i++) {
+    Material::Ptr m = sim.GetMaterial(qr.GetVal<int>("ResourceId", i));
+    if (qr.GetVal<int>("Time", i) == 1) {
+      // the first assembly out of the initial core burned for 1 time step
+      EXPECT_EQ(c_low->id(), m->comp()->id());
+      continue;
+    }
+    // every later assembly burned for 2 time steps
+    MatQuery mq(m);
+    EXPECT_NEAR(0.02, mq.mass_frac(922350000), 1e-10);
+    if (mixed_id < 0) {
+      mixed_id = m->comp()->id();
+    }
+    EXPECT_EQ(mixed_id, m->comp()->id());
+  }
+
+  // the interpolated composition is registered as a recipe so it survives a
+  // restart
+  conds.clear();
+  conds.push_back(Cond("QualId", "==", mixed_id));
+  qr = sim.db().Query("Recipes", &conds);
+  ASSERT_EQ(1, qr.rows.size());
+  std::stringstream name;
+  name << "burnup:" << id << ":uox:2";
+  EXPECT_EQ(name.str(), qr.GetVal<std::string>("Recipe", 0));
+}
+
+// burnup tables keyed on a commodity the reactor never receives are a
+// configuration error.
+TEST(ReactorTests, BurnupUnknownCommod) {
+  std::string config =
+     "  <fuel_inrecipes>  <val>uox</val>      </fuel_inrecipes>  "
+     "  <fuel_outrecipes> <val>spentuox</val> </fuel_outrecipes>  "
+     "  <fuel_incommods>  <val>uox</val>      </fuel_incommods>  "
+     "  <fuel_outcommods> <val>waste</val>    </fuel_outcommods>  "
+     ""
+     "  <burnup_commods> <val>mox</val>       </burnup_commods>  "
+     "  <burnup_times>   <val>1</val>         </burnup_times>  "
+     "  <burnup_recipes> <val>spentuox</val>  </burnup_recipes>  "
+     ""
+     "  <cycle_time>1</cycle_time>  "
+     "  <refuel_time>0</refuel_time>  "
+     "  <assem_size>1</assem_size>  "
+     "  <n_assem_core>1</n_assem_core>  "
+     "  <n_assem_batch>1</n_assem_batch>  ";
+
+  int simdur = 2;
+  cyclus::MockSim sim(cyclus::AgentSpec(":cycamore:Reactor"), config, simdur);
+  sim.AddRecipe("uox", c_uox());
+  sim.AddRecipe("spentuox", c_spentuox());
+  EXPECT_THROW(sim.Run(), cyclus::ValueError);
+}
+
 // tests that spent fuel is offerred on correct commods according to the
 // incommod it was received on - esp when dealing with multiple fuel commods
 // simultaneously.
@@ -457,6 +597,230 @@ TEST(ReactorTests, SpentFuelProperCommodTracking) {
   EXPECT_EQ(2*(simdur-1), qr.rows.size());
 }
 
+// Tests that inventories snapshotted from a reactor can be restored into a
+// copy of it before it enters the simulation, as on a restart - spent fuel is
+// filed by outcommod, which needs the fuel slots that are otherwise only
+// built in EnterNotify.
+TEST(ReactorTests, SnapshotInvRoundTrip) {
+  std::string config =
+     "  <fuel_inrecipes>  <val>uox</val>      <val>mox</val>      </fuel_inrecipes>  "
+     "  <fuel_outrecipes> <val>spentuox</val> <val>spentmox</val> </fuel_outrecipes>  "
+     "  <fuel_incommods>  <val>uox</val>      <val>mox</val>      </fuel_incommods>  "
+     "  <fuel_outcommods> <val>waste1</val>   <val>waste2</val>   </fuel_outcommods>  "
+     ""
+     "  <cycle_time>1</cycle_time>  "
+     "  <refuel_time>0</refuel_time>  "
+     "  <assem_size>1</assem_size>  "
+     "  <n_assem_core>3</n_assem_core>  "
+     "  <n_assem_batch>3</n_assem_batch>  ";
+
+  int simdur = 4;
+  cyclus::MockSim sim(cyclus::AgentSpec(":cycamore:Reactor"), config, simdur);
+  sim.AddSource("uox").capacity(1).Finalize();
+  sim.AddSource("mox").capacity(2).Finalize();
+  sim.AddRecipe("uox", c_uox());
+  sim.AddRecipe("spentuox", c_spentuox());
+  sim.AddRecipe("mox", c_mox());
+  sim.AddRecipe("spentmox", c_spentmox());
+  sim.Run();
+
+  Reactor* r = dynamic_cast<Reactor*>(sim.agent);
+  ASSERT_TRUE(r != NULL);
+  cyclus::Inventories invs = r->SnapshotInv();
+  std::vector<cyclus::Resource::Ptr> spent = invs["spent"];
+  ASSERT_EQ(3 * (simdur - 1), spent.size());
+
+  Reactor* restored = dynamic_cast<Reactor*>(r->Clone());
+  EXPECT_NO_THROW(restored->InitInv(invs));
+  cyclus::Inventories got = restored->SnapshotInv();
+  ASSERT_EQ(spent.size(), got["spent"].size());
+  for (int i = 0; i < spent.size(); i++) {
+    EXPECT_EQ(spent[i]->obj_id(), got["spent"][i]->obj_id());
+  }
+  EXPECT_EQ(invs["core"].size(), got["core"].size());
+  delete restored;
+}
+
+// tests that aggregated spent fuel bids are fulfilled with one material per
+// trade made of whole assemblies of the bid composition.
+TEST(ReactorTests, AggregateBids) {
+  std::string config =
+     "  <fuel_inrecipes>  <val>uox</val>      <val>mox</val>      </fuel_inrecipes>  "
+     "  <fuel_outrecipes> <val>spentuox</val> <val>spentmox</val> </fuel_outrecipes>  "
+     "  <fuel_incommods>  <val>uox</val>      <val>mox</val>      </fuel_incommods>  "
+     "  <fuel_outcommods> <val>waste</val>    <val>waste</val>    </fuel_outcommods>  "
+     ""
+     "  <cycle_time>1</cycle_time>  "
+     "  <refuel_time>0</refuel_time>  "
+     "  <assem_size>1</assem_size>  "
+     "  <n_assem_core>3</n_assem_core>  "
+     "  <n_assem_batch>3</n_assem_batch>  "
+     "  <aggregate_bids>1</aggregate_bids>  ";
+
+  int simdur = 7;
+  cyclus::MockSim sim(cyclus::AgentSpec(":cycamore:Reactor"), config, simdur);
+  sim.AddSource("uox").capacity(1).Finalize();
+  sim.AddSource("mox").capacity(2).Finalize();
+  sim.AddSink("waste").Finalize();
+  sim.AddRecipe("uox", c_uox());
+  Composition::Ptr spentuox = c_spentuox();
+  sim.AddRecipe("spentuox", spentuox);
+  sim.AddRecipe("mox", c_mox());
+  Composition::Ptr spentmox = c_spentmox();
+  sim.AddRecipe("spentmox", spentmox);
+  int id = sim.Run();
+
+  std::vector<Cond> conds;
+  conds.push_back(Cond("SenderId", "==", id));
+  conds.push_back(Cond("Commodity", "==", std::string("waste")));
+  QueryResult qr = sim.db().Query("Transactions", &conds);
+  ASSERT_EQ(2*(simdur-1), qr.rows.size());
+
+  int nuox = 0;
+  int nmox = 0;
+  for (int i = 0; i < qr.rows.size(); i++) {
+    Material::Ptr m = sim.GetMaterial(qr.GetVal<int>("ResourceId", i));
+    if (m->comp()->id() == spentuox->id()) {
+      EXPECT_DOUBLE_EQ(1, m->quantity());
+      nuox++;
+    } else if (m->comp()->id() == spentmox->id()) {
+      EXPECT_DOUBLE_EQ(2, m->quantity());
+      nmox++;
+    }
+  }
+  EXPECT_EQ(simdur-1, nuox);
+  EXPECT_EQ(simdur-1, nmox);
+}
+
+// tests that two requests competing for one aggregated group neither get
+// more than the group holds nor more than they asked for.
+TEST(ReactorTests, AggregateBidsCompeting) {
+  std::string config =
+     "  <fuel_inrecipes>  <val>uox</val>      </fuel_inrecipes>  "
+     "  <fuel_outrecipes> <val>spentuox</val> </fuel_outrecipes>  "
+     "  <fuel_incommods>  <val>uox</val>      </fuel_incommods>  "
+     "  <fuel_outcommods> <val>waste</val>    </fuel_outcommods>  "
+     ""
+     "  <cycle_time>1</cycle_time>  "
+     "  <refuel_time>0</refuel_time>  "
+     "  <assem_size>1</assem_size>  "
+     "  <n_assem_core>2</n_assem_core>  "
+     "  <n_assem_batch>2</n_assem_batch>  "
+     "  <aggregate_bids>1</aggregate_bids>  ";
+
+  int simdur = 7;
+  cyclus::MockSim sim(cyclus::AgentSpec(":cycamore:Reactor"), config, simdur);
+  sim.AddSource("uox").Finalize();
+  sim.AddSink("waste").capacity(1.5).Finalize();
+  sim.AddSink("waste").capacity(1.5).Finalize();
+  sim.AddRecipe("uox", c_uox());
+  sim.AddRecipe("spentuox", c_spentuox());
+  int id = sim.Run();
+
+  // two assemblies are discharged every step after the first; each request
+  // fits only one of them.
+  std::vector<Cond> conds;
+  conds.push_back(Cond("SenderId", "==", id));
+  conds.push_back(Cond("Commodity", "==", std::string("waste")));
+  QueryResult qr = sim.db().Query("Transactions", &conds);
+  ASSERT_EQ(2*(simdur-1), qr.rows.size());
+  for (int i = 0; i < qr.rows.size(); i++) {
+    Material::Ptr m = sim.GetMaterial(qr.GetVal<int>("ResourceId", i));
+    EXPECT_DOUBLE_EQ(1, m->quantity());
+  }
+}
+
+// tests that typed events break assembly counts and quantities down by the
+// commodity the assemblies were received or are offered on.
+TEST(ReactorTests, EventLog) {
+  std::string config =
+     "  <fuel_inrecipes>  <val>uox</val>      <val>mox</val>      </fuel_inrecipes>  "
+     "  <fuel_outrecipes> <val>spentuox</val> <val>spentmox</val> </fuel_outrecipes>  "
+     "  <fuel_incommods>  <val>uox</val>      <val>mox</val>      </fuel_incommods>  "
+     "  <fuel_outcommods> <val>waste1</val>   <val>waste2</val>   </fuel_outcommods>  "
+     ""
+     "  <cycle_time>1</cycle_time>  "
+     "  <refuel_time>0</refuel_time>  "
+     "  <assem_size>1</assem_size>  "
+     "  <n_assem_core>3</n_assem_core>  "
+     "  <n_assem_batch>3</n_assem_batch>  ";
+
+  int simdur = 7;
+  cyclus::MockSim sim(cyclus::AgentSpec(":cycamore:Reactor"), config, simdur);
+  sim.AddSource("uox").capacity(1).Finalize();
+  sim.AddSource("mox").capacity(2).Finalize();
+  sim.AddRecipe("uox", c_uox());
+  sim.AddRecipe("spentuox", c_spentuox());
+  sim.AddRecipe("mox", c_mox());
+  sim.AddRecipe("spentmox", c_spentmox());
+  int id = sim.Run();
+
+  std::vector<Cond> conds;
+  conds.push_back(Cond("Event", "==", static_cast<int>(kEventLoad)));
+  conds.push_back(Cond("Commodity", "==", std::string("mox")));
+  QueryResult qr = sim.db().Query("ReactorEventLog", &conds);
+  ASSERT_EQ(simdur, qr.rows.size());
+  for (int i = 0; i < qr.rows.size(); i++) {
+    EXPECT_EQ(2, qr.GetVal<int>("NAssemblies", i));
+    EXPECT_DOUBLE_EQ(2, qr.GetVal<double>("Quantity", i));
+  }
+
+  conds[0] = Cond("Event", "==", static_cast<int>(kEventDischarge));
+  conds[1] = Cond("Commodity", "==", std::string("waste1"));
+  qr = sim.db().Query("ReactorEventLog", &conds);
+  ASSERT_EQ(simdur-1, qr.rows.size());
+  for (int i = 0; i < qr.rows.size(); i++) {
+    EXPECT_EQ(1, qr.GetVal<int>("NAssemblies", i));
+  }
+
+  conds.resize(1);
+  conds[0] = Cond("Event", "==", static_cast<int>(kEventCycleStart));
+  qr = sim.db().Query("ReactorEventLog", &conds);
+  EXPECT_EQ(simdur, qr.rows.size());
+
+  // text events are still recorded by default
+  std::vector<Cond> textconds;
+  textconds.push_back(Cond("Event", "==", std::string("CYCLE_START")));
+  qr = sim.db().Query("ReactorEvents", &textconds);
+  EXPECT_EQ(simdur, qr.rows.size());
+}
+
+// tests that the spent fuel supply recorded on discharge is tracked
+// separately for each outcommod - esp when fuel is held (not traded) for
+// many cycles.
+TEST(ReactorTests, SpentFuelSupplyByCommod) {
+  std::string config =
+     "  <fuel_inrecipes>  <val>uox</val>      <val>mox</val>      </fuel_inrecipes>  "
+     "  <fuel_outrecipes> <val>spentuox</val> <val>spentmox</val> </fuel_outrecipes>  "
+     "  <fuel_incommods>  <val>uox</val>      <val>mox</val>      </fuel_incommods>  "
+     "  <fuel_outcommods> <val>waste1</val>   <val>waste2</val>   </fuel_outcommods>  "
+     ""
+     "  <cycle_time>1</cycle_time>  "
+     "  <refuel_time>0</refuel_time>  "
+     "  <assem_size>1</assem_size>  "
+     "  <n_assem_core>3</n_assem_core>  "
+     "  <n_assem_batch>3</n_assem_batch>  ";
+
+  int simdur = 7;
+  cyclus::MockSim sim(cyclus::AgentSpec(":cycamore:Reactor"), config, simdur);
+  sim.AddSource("uox").capacity(1).Finalize();
+  sim.AddSource("mox").capacity(2).Finalize();
+  sim.AddRecipe("uox", c_uox());
+  sim.AddRecipe("spentuox", c_spentuox());
+  sim.AddRecipe("mox", c_mox());
+  sim.AddRecipe("spentmox", c_spentmox());
+  int id = sim.Run();
+
+  // no sinks - so all discharged fuel accumulates in the spent inventory
+  std::vector<Cond> conds;
+  conds.push_back(Cond("Time", "==", simdur - 1));
+  QueryResult qr = sim.db().Query("TimeSeriessupplywaste1", &conds);
+  EXPECT_DOUBLE_EQ(simdur - 1, qr.GetVal<double>("Value"));
+
+  qr = sim.db().Query("TimeSeriessupplywaste2", &conds);
+  EXPECT_DOUBLE_EQ(2 * (simdur - 1), qr.GetVal<double>("Value"));
+}
+
 // The user can optionally omit fuel preferences.  In the case where
 // preferences are adjusted, the ommitted preference vector must be populated
 // with default values - if it wasn't then preferences won't be adjusted
@@ -490,6 +854,37 @@ TEST(ReactorTests, PrefChange) {
   EXPECT_EQ(25, qr.rows.size()) << "failed to adjust preferences properly";
 }
 
+// Checks that preference changes specified out of time order are still
+// applied on their respective time steps.
+TEST(ReactorTests, PrefChangeUnordered) {
+  std::string config =
+     "  <fuel_inrecipes>  <val>lwr_fresh</val>  </fuel_inrecipes>  "
+     "  <fuel_outrecipes> <val>lwr_spent</val>  </fuel_outrecipes>  "
+     "  <fuel_incommods>  <val>enriched_u</val> </fuel_incommods>  "
+     "  <fuel_outcommods> <val>waste</val>      </fuel_outcommods>  "
+     ""
+     "  <cycle_time>1</cycle_time>  "
+     "  <refuel_time>0</refuel_time>  "
+     "  <assem_size>300</assem_size>  "
+     "  <n_assem_core>1</n_assem_core>  "
+     "  <n_assem_batch>1</n_assem_batch>  "
+     ""
+     "  <pref_change_times>   <val>35</val>         <val>25</val>         <val>99</val>   </pref_change_times>"
+     "  <pref_change_commods> <val>enriched_u</val> <val>enriched_u</val> <val>foo</val>  </pref_change_commods>"
+     "  <pref_change_values>  <val>1</val>          <val>-1</val>         <val>-1</val>   </pref_change_values>";
+
+  int simdur = 50;
+  cyclus::MockSim sim(cyclus::AgentSpec(":cycamore:Reactor"), config, simdur);
+  sim.AddSource("enriched_u").Finalize();
+  sim.AddRecipe("lwr_fresh", c_uox());
+  sim.AddRecipe("lwr_spent", c_spentuox());
+  int id = sim.Run();
+
+  // fuel is received on 0-24 and again on 35-49
+  QueryResult qr = sim.db().Query("Transactions", NULL);
+  EXPECT_EQ(25 + 15, qr.rows.size()) << "failed to apply unordered preference changes";
+}
+
 TEST(ReactorTests, RecipeChange) {
   // it is important that the fuel_prefs not be present in the config below.
   std::string config =
@@ -758,6 +1153,192 @@ TEST(ReactorTests, MultipleByProduct) {
 
 }
 
+// tests that interval recording covers every time step with one row per
+// unchanged run - both at the end of the simulation and on decommissioning -
+// and that expanding intervals keeps recording the per-time step rows.
+TEST(ReactorTests, RecordIntervals) {
+  std::string config =
+     "  <fuel_inrecipes>  <val>uox</val>      </fuel_inrecipes>  "
+     "  <fuel_outrecipes> <val>spentuox</val> </fuel_outrecipes>  "
+     "  <fuel_incommods>  <val>uox</val>      </fuel_incommods>  "
+     "  <fuel_outcommods> <val>waste</val>    </fuel_outcommods>  "
+     ""
+     "  <cycle_time>2</cycle_time>  "
+     "  <refuel_time>2</refuel_time>  "
+     "  <assem_size>1</assem_size>  "
+     "  <n_assem_core>3</n_assem_core>  "
+     "  <power_cap>1000</power_cap>  "
+     "  <n_assem_batch>1</n_assem_batch>  "
+     "  <record_intervals>1</record_intervals>  "
+     "  <expand_intervals>1</expand_intervals>  "
+     ""
+     "  <side_products> <val>process_heat</val> </side_products>"
+     "  <side_product_quantity> <val>10</val> </side_product_quantity>";
+
+  int simdur = 12;
+  int lifetime = 7;
+  cyclus::MockSim sim(cyclus::AgentSpec(":cycamore:Reactor"), config, simdur, lifetime);
+  sim.AddSource("uox").Finalize();
+  sim.AddSink("waste").Finalize();
+  sim.AddRecipe("uox", c_uox());
+  sim.AddRecipe("spentuox", c_spentuox());
+  int id = sim.Run();
+
+  // on for 2, off for 2, on for 2, off for 1
+  std::vector<Cond> conds;
+  conds.push_back(Cond("Series", "==", std::string("Power")));
+  QueryResult qr = sim.db().Query("ReactorIntervals", &conds);
+  ASSERT_EQ(4, qr.rows.size());
+  int on_time = 0;
+  int off_time = 0;
+  for (int i = 0; i < qr.rows.size(); i++) {
+    int n = qr.GetVal<int>("EndTime", i) - qr.GetVal<int>("StartTime", i) + 1;
+    if (qr.GetVal<double>("Value", i) == 1000) {
+      on_time += n;
+    } else {
+      off_time += n;
+    }
+  }
+  EXPECT_EQ(4, on_time);
+  EXPECT_EQ(3, off_time);
+
+  conds[0] = Cond("Series", "==", std::string("process_heat"));
+  qr = sim.db().Query("ReactorIntervals", &conds);
+  EXPECT_EQ(4, qr.rows.size());
+
+  conds[0] = Cond("Value", "==", 1000);
+  qr = sim.db().Query("TimeSeriesPower", &conds);
+  EXPECT_EQ(4, qr.rows.size());
+  qr = sim.db().Query("TimeSeriessupplyPOWER", &conds);
+  EXPECT_EQ(4, qr.rows.size());
+  conds[0] = Cond("Value", "==", 0);
+  qr = sim.db().Query("TimeSeriesPower", &conds);
+  EXPECT_EQ(3, qr.rows.size());
+  conds[0] = Cond("Value", "==", 10);
+  qr = sim.db().Query("ReactorSideProducts", &conds);
+  EXPECT_EQ(4, qr.rows.size());
+}
+
+// Check that intervals are written when the reactor retires still holding
+// spent fuel and is therefore never decommissioned.
+TEST(ReactorTests, RecordIntervalsRetiredWithSpent) {
+  std::string config =
+     "  <fuel_inrecipes>  <val>uox</val>      </fuel_inrecipes>  "
+     "  <fuel_outrecipes> <val>spentuox</val> </fuel_outrecipes>  "
+     "  <fuel_incommods>  <val>uox</val>      </fuel_incommods>  "
+     "  <fuel_outcommods> <val>waste</val>    </fuel_outcommods>  "
+     ""
+     "  <cycle_time>2</cycle_time>  "
+     "  <refuel_time>2</refuel_time>  "
+     "  <assem_size>1</assem_size>  "
+     "  <n_assem_core>3</n_assem_core>  "
+     "  <power_cap>1000</power_cap>  "
+     "  <n_assem_batch>1</n_assem_batch>  "
+     "  <record_intervals>1</record_intervals>  "
+     ""
+     "  <side_products> <val>process_heat</val> </side_products>"
+     "  <side_product_quantity> <val>10</val> </side_product_quantity>";
+
+  int simdur = 12;
+  int lifetime = 7;
+  cyclus::MockSim sim(cyclus::AgentSpec(":cycamore:Reactor"), config, simdur, lifetime);
+  sim.AddSource("uox").Finalize();
+  sim.AddRecipe("uox", c_uox());
+  sim.AddRecipe("spentuox", c_spentuox());
+  int id = sim.Run();
+
+  // on for 2, off for 2, on for 2, off for 1
+  std::vector<Cond> conds;
+  conds.push_back(Cond("AgentId", "==", id));
+  conds.push_back(Cond("Series", "==", std::string("Power")));
+  QueryResult qr = sim.db().Query("ReactorIntervals", &conds);
+  ASSERT_EQ(4, qr.rows.size());
+  int steps = 0;
+  for (int i = 0; i < qr.rows.size(); i++) {
+    steps += qr.GetVal<int>("EndTime", i) - qr.GetVal<int>("StartTime", i) + 1;
+  }
+  EXPECT_EQ(lifetime, steps);
+
+  conds[1] = Cond("Series", "==", std::string("process_heat"));
+  qr = sim.db().Query("ReactorIntervals", &conds);
+  EXPECT_EQ(4, qr.rows.size());
+}
+
+// Exercises the assembly index at fleet scale (10^5 assemblies spread across
+// many reactors) checking that lookups are correct and that table memory
+// follows the number of assemblies actually held.  Lookup cost and resident
+// table memory are reported as test properties.
+TEST(AssemblyIndexTests, FleetScale) {
+  int n_rxtrs = 100;
+  int n_assem = 100000;
+  std::vector<AssemblyIndex> idx(n_rxtrs);
+  for (int i = 0; i < n_assem; i++) {
+    idx[i % n_rxtrs].Set(i, i % 3);
+  }
+
+  int n_wrong = 0;
+  std::chrono::steady_clock::time_point start =
+      std::chrono::steady_clock::now();
+  for (int i = 0; i < n_assem; i++) {
+    if (idx[i % n_rxtrs].Get(i) != i % 3) {
+      n_wrong++;
+    }
+  }
+  std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+  EXPECT_EQ(0, n_wrong);
+  EXPECT_EQ(-1, idx[0].Get(n_assem));
+
+  int n_entries = 0;
+  for (int i = 0; i < n_rxtrs; i++) {
+    EXPECT_EQ(n_assem / n_rxtrs, idx[i].size());
+    n_entries += idx[i].capacity();
+  }
+  EXPECT_LE(n_entries, 4 * n_assem);
+
+  double ns = std::chrono::duration<double, std::nano>(end - start).count();
+  RecordProperty("LookupNanoseconds", static_cast<int>(ns / n_assem));
+  RecordProperty("ResidentBytes",
+                 static_cast<int>(n_entries * 2 * sizeof(int)));
+
+  // trade away all but the last assembly from each reactor
+  for (int i = 0; i < n_assem - n_rxtrs; i++) {
+    EXPECT_TRUE(idx[i % n_rxtrs].Erase(i));
+  }
+  for (int i = n_assem - n_rxtrs; i < n_assem; i++) {
+    EXPECT_EQ(i % 3, idx[i % n_rxtrs].Get(i));
+  }
+  n_entries = 0;
+  for (int i = 0; i < n_rxtrs; i++) {
+    EXPECT_EQ(1, idx[i].size());
+    n_entries += idx[i].capacity();
+  }
+  EXPECT_LE(n_entries, 16 * n_rxtrs);
+
+  for (int i = n_assem - n_rxtrs; i < n_assem; i++) {
+    EXPECT_TRUE(idx[i % n_rxtrs].Erase(i));
+    EXPECT_FALSE(idx[i % n_rxtrs].Erase(i));
+  }
+  for (int i = 0; i < n_rxtrs; i++) {
+    EXPECT_EQ(0, idx[i].capacity());
+  }
+}
+
+// Object ids with power of two strides must not pile up on a few home slots.
+TEST(AssemblyIndexTests, StridedIds) {
+  int n = 1000;
+  int strides[] = {1, 1024, 65536};
+  for (int k = 0; k < 3; k++) {
+    AssemblyIndex idx;
+    for (int i = 1; i <= n; i++) {
+      idx.Set(i * strides[k], i % 3);
+    }
+    EXPECT_LE(idx.MaxProbe(), 8) << "stride " << strides[k];
+    for (int i = 1; i <= n; i++) {
+      EXPECT_EQ(i % 3, idx.Get(i * strides[k]));
+    }
+  }
+}
+
 } // namespace reactortests
 } // namespace cycamore
 
@@ -1,5 +1,9 @@
 #include "separations.h"
 
+#include <algorithm>
+#include <set>
+#include <sstream>
+
 using cyclus::Material;
 using cyclus::Composition;
 using cyclus::toolkit::ResBuf;
@@ -9,7 +13,9 @@ using cyclus::Request;
 namespace cycamore {
 
 Separations::Separations(cyclus::Context* ctx)
-    : cyclus::Facility(ctx) {}
+    : cyclus::Facility(ctx),
+      coalesce_streams(false),
+      separate_batches(false) {}
 
 cyclus::Inventories Separations::SnapshotInv() {
   cyclus::Inventories invs;
@@ -22,10 +28,10 @@ cyclus::Inventories Separations::SnapshotInv() {
   invs["feed-inv-name"] = feed.PopNRes(feed.count());
   feed.Push(invs["feed-inv-name"]);
 
-  std::map<std::string, ResBuf<Material> >::iterator it;
-  for (it = streambufs.begin(); it != streambufs.end(); ++it) {
-    invs[it->first] = it->second.PopNRes(it->second.count());
-    it->second.Push(invs[it->first]);
+  for (int i = 0; i < streambufs.size(); i++) {
+    std::string name = stream_names_[i];
+    invs[name] = streambufs[i].PopNRes(streambufs[i].count());
+    streambufs[i].Push(invs[name]);
   }
 
   return invs;
@@ -35,9 +41,13 @@ void Separations::InitInv(cyclus::Inventories& inv) {
   leftover.Push(inv["leftover-inv-name"]);
   feed.Push(inv["feed-inv-name"]);
 
+  IndexStreams_();
   cyclus::Inventories::iterator it;
   for (it = inv.begin(); it != inv.end(); ++it) {
-    streambufs[it->first].Push(it->second);
+    std::map<std::string, int>::iterator idx = stream_index_.find(it->first);
+    if (idx != stream_index_.end()) {
+      streambufs[idx->second].Push(it->second);
+    }
   }
 }
 
@@ -51,13 +61,11 @@ void Separations::EnterNotify() {
   StreamSet::iterator it;
   std::map<int, double>::iterator it2;
 
+  IndexStreams_();
+  std::vector<std::map<int, double> > effs;
   for (it = streams_.begin(); it != streams_.end(); ++it) {
-    std::string name = it->first;
     Stream stream = it->second;
-    double cap = stream.first;
-    if (cap >= 0) {
-      streambufs[name].capacity(cap);
-    }
+    effs.push_back(stream.second);
 
     for (it2 = stream.second.begin(); it2 != stream.second.end(); it2++) {
       efficiency_[it2->first] += it2->second;
@@ -89,6 +97,7 @@ void Separations::EnterNotify() {
 
     throw cyclus::ValueError(ss.str());
   }
+  sep_matrix_ = SepMatrix(effs);
 
   if (feed_commod_prefs.size() == 0) {
     for (int i = 0; i < feed_commods.size(); i++) {
@@ -97,44 +106,59 @@ void Separations::EnterNotify() {
   }
 }
 
+void Separations::IndexStreams_() {
+  stream_names_.clear();
+  stream_index_.clear();
+  streambufs.resize(streams_.size());
+
+  StreamSet::iterator it;
+  for (it = streams_.begin(); it != streams_.end(); ++it) {
+    int i = stream_names_.size();
+    double cap = it->second.first;
+    if (cap >= 0) {
+      streambufs[i].capacity(cap);
+    }
+    stream_index_[it->first] = i;
+    stream_names_.push_back(it->first);
+  }
+}
+
 void Separations::Tick() {
   using cyclus::toolkit::RecordTimeSeries;
   if (feed.count() == 0) {
     return;
+  } else if (separate_batches) {
+    SeparateBatches_();
+    return;
   }
   double pop_qty = std::min(throughput, feed.quantity());
   Material::Ptr mat = feed.Pop(pop_qty, cyclus::eps_rsrc());
   double orig_qty = mat->quantity();
 
-  StreamSet::iterator it;
   double maxfrac = 1;
-  std::map<std::string, Material::Ptr> stagedsep;
+  std::vector<Material::Ptr> stagedsep;
   Record("Separating", orig_qty, "feed");
-  for (it = streams_.begin(); it != streams_.end(); ++it) {
-    Stream info = it->second;
-    std::string name = it->first;
-    stagedsep[name] = SepMaterial(info.second, mat);
-    double frac = streambufs[name].space() / stagedsep[name]->quantity();
+  sep_matrix_.Split(mat, &stagedsep);
+  for (int i = 0; i < stagedsep.size(); i++) {
+    double frac = streambufs[i].space() / stagedsep[i]->quantity();
     if (frac < maxfrac) {
       maxfrac = frac;
     }
   }
 
-  std::map<std::string, Material::Ptr>::iterator itf;
-  for (itf = stagedsep.begin(); itf != stagedsep.end(); ++itf) {
-    std::string name = itf->first;
-    Material::Ptr m = itf->second;
+  for (int i = 0; i < stagedsep.size(); i++) {
+    Material::Ptr m = stagedsep[i];
     if (m->quantity() > 0) {
       double qty = m->quantity();
       if (m->quantity() > mat->quantity()) {
         qty = mat->quantity();
       }
-      streambufs[name].Push(
+      streambufs[i].Push(
           mat->ExtractComp(qty * maxfrac, m->comp()));
-      Record("Separated", qty * maxfrac, name);
+      Record("Separated", qty * maxfrac, stream_names_[i]);
     }
-    cyclus::toolkit::RecordTimeSeries<double>("supply"+name, this,
-                                              streambufs[name].quantity());
+    cyclus::toolkit::RecordTimeSeries<double>("supply"+stream_names_[i], this,
+                                              streambufs[i].quantity());
   }
 
   if (maxfrac == 1) {
@@ -156,38 +180,180 @@ void Separations::Tick() {
 
 }
 
+void Separations::SeparateBatches_() {
+  MatVec batches = feed.PopN(feed.count());
+  MatVec unprocessed;
+
+  // space left in each stream is used up batch by batch, and a batch is only
+  // held back by the streams it actually separates into
+  std::vector<double> space(stream_names_.size());
+  for (int i = 0; i < stream_names_.size(); i++) {
+    space[i] = streambufs[i].space();
+  }
+
+  double remaining = throughput;
+  std::vector<Material::Ptr> stagedsep;
+  for (int b = 0; b < batches.size(); b++) {
+    Material::Ptr mat = batches[b];
+    if (remaining < cyclus::eps_rsrc()) {
+      unprocessed.push_back(mat);
+      continue;
+    } else if (mat->quantity() > remaining) {
+      unprocessed.push_back(mat);
+      mat = mat->ExtractQty(remaining);
+    }
+    double orig_qty = mat->quantity();
+
+    double maxfrac = 1;
+    sep_matrix_.Split(mat, &stagedsep);
+    for (int i = 0; i < stagedsep.size(); i++) {
+      if (stagedsep[i]->quantity() > 0) {
+        maxfrac = std::min(maxfrac, space[i] / stagedsep[i]->quantity());
+      }
+    }
+    if (maxfrac <= 0) {
+      unprocessed.push_back(mat);
+      continue;
+    }
+
+    if (maxfrac < 1) {
+      // hold back the part of the batch that doesn't fit in its streams
+      // before separating, so it keeps the batch's composition
+      unprocessed.push_back(mat->ExtractQty((1 - maxfrac) * orig_qty));
+      sep_matrix_.Split(mat, &stagedsep);
+    }
+
+    Record("Separating", orig_qty * maxfrac, "feed");
+    for (int i = 0; i < stagedsep.size(); i++) {
+      Material::Ptr m = stagedsep[i];
+      if (m->quantity() > 0) {
+        double qty = std::min(m->quantity(), mat->quantity());
+        streambufs[i].Push(mat->ExtractComp(qty, m->comp()));
+        space[i] -= qty;
+        Record("Separated", qty, stream_names_[i]);
+      }
+    }
+
+    if (mat->quantity() > 0) {
+      // unspecified separations fractions go to leftovers
+      leftover.Push(mat);
+    }
+    remaining -= orig_qty * maxfrac;
+  }
+  feed.Push(unprocessed);
+
+  for (int i = 0; i < stream_names_.size(); i++) {
+    cyclus::toolkit::RecordTimeSeries<double>(
+        "supply" + stream_names_[i], this, streambufs[i].quantity());
+  }
+  cyclus::toolkit::RecordTimeSeries<double>("supply"+leftover_commod, this,
+                                            leftover.quantity());
+}
+
 // Note that this returns an untracked material that should just be used for
 // its composition and qty - not in any real inventories, etc.
 Material::Ptr SepMaterial(std::map<int, double> effs, Material::Ptr mat) {
+  std::vector<Material::Ptr> seps;
+  SepMatrix(std::vector<std::map<int, double> >(1, effs)).Split(mat, &seps);
+  return seps[0];
+};
+
+namespace {
+
+// element rows are stored for atomic numbers below kMaxZ
+const int kMaxZ = 120;
+
+int ElemZ(int nuc) {
+  return nuc / 10000000;
+}
+
+}  // namespace
+
+SepMatrix::SepMatrix(const std::vector<std::map<int, double> >& effs)
+    : nstreams_(effs.size()),
+      elem_rows_(kMaxZ * effs.size(), 0),
+      elem_used_(kMaxZ, false) {
+  std::map<int, double>::const_iterator it;
+  std::set<int> nucs;
+  for (int s = 0; s < nstreams_; s++) {
+    for (it = effs[s].begin(); it != effs[s].end(); ++it) {
+      int z = ElemZ(it->first);
+      if (z < 0 || z >= kMaxZ) {
+        std::stringstream ss;
+        ss << "invalid separations component " << it->first;
+        throw cyclus::ValueError(ss.str());
+      } else if (it->first == z * 10000000) {
+        elem_rows_[z * nstreams_ + s] = it->second;
+        elem_used_[z] = true;
+      } else {
+        nucs.insert(it->first);
+      }
+    }
+  }
+
+  // expand nuclide rows with each stream's element efficiency
+  nucs_.assign(nucs.begin(), nucs.end());
+  nuc_rows_.resize(nucs_.size() * nstreams_);
+  for (int i = 0; i < nucs_.size(); i++) {
+    int nuc = nucs_[i];
+    int z = ElemZ(nuc);
+    for (int s = 0; s < nstreams_; s++) {
+      it = effs[s].find(nuc);
+      nuc_rows_[i * nstreams_ + s] =
+          it != effs[s].end() ? it->second : elem_rows_[z * nstreams_ + s];
+    }
+  }
+}
+
+const double* SepMatrix::Row(int nuc) const {
+  if (!nucs_.empty()) {
+    std::vector<int>::const_iterator it =
+        std::lower_bound(nucs_.begin(), nucs_.end(), nuc);
+    if (it != nucs_.end() && *it == nuc) {
+      return &nuc_rows_[(it - nucs_.begin()) * nstreams_];
+    }
+  }
+  int z = ElemZ(nuc);
+  if (z < 0 || z >= kMaxZ || !elem_used_[z]) {
+    return NULL;
+  }
+  return &elem_rows_[z * nstreams_];
+}
+
+void SepMatrix::Split(Material::Ptr mat,
+                      std::vector<Material::Ptr>* seps) const {
   using cyclus::CompMap;
 
-  CompMap cm = mat->comp()->mass();
-  cyclus::compmath::Normalize(&cm, mat->quantity());
-  double tot_qty = 0;
-  CompMap sepcomp;
+  // separated masses are relative to the composition's own total, and are
+  // scaled to the material quantity once at the end
+  std::vector<CompMap> sepcomps(nstreams_);
+  std::vector<double> sepqtys(nstreams_, 0);
+  double tot = 0;
 
-  CompMap::iterator it;
+  const CompMap& cm = mat->comp()->mass();
+  CompMap::const_iterator it;
   for (it = cm.begin(); it != cm.end(); ++it) {
-    int nuc = it->first;
-    int elem = (nuc / 10000000) * 10000000;
-    double eff = 0;
-    if (effs.count(nuc) > 0) {
-      eff = effs[nuc];
-    } else if (effs.count(elem) > 0) {
-      eff = effs[elem];
-    } else {
+    tot += it->second;
+    const double* row = Row(it->first);
+    if (row == NULL) {
       continue;
     }
-
-    double qty = it->second;
-    double sepqty = qty * eff;
-    sepcomp[nuc] = sepqty;
-    tot_qty += sepqty;
+    for (int s = 0; s < nstreams_; s++) {
+      if (row[s] > 0) {
+        double sepqty = it->second * row[s];
+        sepcomps[s][it->first] = sepqty;
+        sepqtys[s] += sepqty;
+      }
+    }
   }
 
-  Composition::Ptr c = Composition::CreateFromMass(sepcomp);
-  return Material::CreateUntracked(tot_qty, c);
-};
+  double scale = tot > 0 ? mat->quantity() / tot : 0;
+  seps->resize(nstreams_);
+  for (int s = 0; s < nstreams_; s++) {
+    (*seps)[s] = Material::CreateUntracked(
+        sepqtys[s] * scale, Composition::CreateFromMass(sepcomps[s]));
+  }
+}
 
 std::set<cyclus::RequestPortfolio<Material>::Ptr>
 Separations::GetMatlRequests() {
@@ -237,16 +403,17 @@ void Separations::GetMatlTrades(
         responses) {
   using cyclus::Trade;
 
-  std::vector<Trade<Material> >::const_iterator it;
+  std::map<std::string, int>::iterator idx;
   for (int i = 0; i < trades.size(); i++) {
     std::string commod = trades[i].request->commodity();
     if (commod == leftover_commod) {
       double amt = std::min(leftover.quantity(), trades[i].amt);
       Material::Ptr m = leftover.Pop(amt, cyclus::eps_rsrc());
       responses.push_back(std::make_pair(trades[i], m));
-    } else if (streambufs.count(commod) > 0) {
-      double amt = std::min(streambufs[commod].quantity(), trades[i].amt);
-      Material::Ptr m = streambufs[commod].Pop(amt, cyclus::eps_rsrc());
+    } else if ((idx = stream_index_.find(commod)) != stream_index_.end()) {
+      ResBuf<Material>& buf = streambufs[idx->second];
+      double amt = std::min(buf.quantity(), trades[i].amt);
+      Material::Ptr m = buf.Pop(amt, cyclus::eps_rsrc());
       responses.push_back(std::make_pair(trades[i], m));
     } else {
       throw cyclus::ValueError("invalid commodity " + commod +
@@ -273,18 +440,18 @@ std::set<cyclus::BidPortfolio<Material>::Ptr> Separations::GetMatlBids(
   std::set<BidPortfolio<Material>::Ptr> ports;
 
   // bid streams
-  std::map<std::string, ResBuf<Material> >::iterator it;
-  for (it = streambufs.begin(); it != streambufs.end(); ++it) {
-    std::string commod = it->first;
-    std::vector<Request<Material>*>& reqs = commod_requests[commod];
+  for (int i = 0; i < streambufs.size(); i++) {
+    ResBuf<Material>& buf = streambufs[i];
+    std::vector<Request<Material>*>& reqs = commod_requests[stream_names_[i]];
     if (reqs.size() == 0) {
       continue;
-    } else if (streambufs[commod].quantity() < cyclus::eps_rsrc()) {
+    } else if (buf.quantity() < cyclus::eps_rsrc()) {
       continue;
     }
 
-    MatVec mats = streambufs[commod].PopN(streambufs[commod].count());
-    streambufs[commod].Push(mats);
+    Coalesce_(&buf);
+    MatVec mats = buf.PopN(buf.count());
+    buf.Push(mats);
 
     BidPortfolio<Material>::Ptr port(new BidPortfolio<Material>());
 
@@ -307,7 +474,7 @@ std::set<cyclus::BidPortfolio<Material>::Ptr> Separations::GetMatlBids(
       }
     }
 
-    double tot_qty = streambufs[commod].quantity();
+    double tot_qty = buf.quantity();
     cyclus::CapacityConstraint<Material> cc(tot_qty);
     port->AddConstraint(cc);
     ports.insert(port);
@@ -316,6 +483,7 @@ std::set<cyclus::BidPortfolio<Material>::Ptr> Separations::GetMatlBids(
   // bid leftovers
   std::vector<Request<Material>*>& reqs = commod_requests[leftover_commod];
   if (reqs.size() > 0 && leftover.quantity() >= cyclus::eps_rsrc()) {
+    Coalesce_(&leftover);
     MatVec mats = leftover.PopN(leftover.count());
     leftover.Push(mats);
 
@@ -355,9 +523,8 @@ bool Separations::CheckDecommissionCondition() {
     return false;
   }
 
-  std::map<std::string, ResBuf<Material> >::iterator it;
-  for (it = streambufs.begin(); it != streambufs.end(); ++it) {
-    if (it->second.count() > 0) {
+  for (int i = 0; i < streambufs.size(); i++) {
+    if (streambufs[i].count() > 0) {
       return false;
     }
   }
@@ -365,6 +532,12 @@ bool Separations::CheckDecommissionCondition() {
   return true;
 }
 
+void Separations::Coalesce_(ResBuf<Material>* buf) {
+  if (coalesce_streams && buf->count() > 1) {
+    buf->Push(cyclus::toolkit::Squash(buf->PopN(buf->count())));
+  }
+}
+
 void Separations::Record(std::string name, double val, std::string type) {
   context()
       ->NewDatum("SeparationEvents")
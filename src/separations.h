@@ -18,6 +18,46 @@ namespace cycamore {
 cyclus::Material::Ptr SepMaterial(std::map<int, double> effs,
                                   cyclus::Material::Ptr mat);
 
+/// SepMatrix holds the mass-based efficiencies of a set of separations
+/// streams as a dense element-by-stream table plus a row for each nuclide
+/// given explicitly in any stream.  Nuclide rows are pre-expanded with each
+/// stream's element efficiency where the stream doesn't name the nuclide, so
+/// looking up the efficiencies of a nuclide for all streams is a single
+/// table access.  This lets a material be split into every stream in one
+/// pass over its composition.
+class SepMatrix {
+ public:
+  SepMatrix() : nstreams_(0) {}
+
+  /// @param effs the efficiencies of each stream, keyed by nuclide or element
+  /// (canonical PyNE form) as for SepMaterial
+  explicit SepMatrix(const std::vector<std::map<int, double> >& effs);
+
+  int nstreams() const { return nstreams_; }
+
+  /// Returns the efficiencies of nuc for each stream, or NULL if nuc isn't
+  /// separated into any stream.
+  const double* Row(int nuc) const;
+
+  /// Splits mat into one untracked material per stream (in stream order),
+  /// with the same compositions and quantities as SepMaterial would give for
+  /// each stream's efficiencies.
+  void Split(cyclus::Material::Ptr mat,
+             std::vector<cyclus::Material::Ptr>* seps) const;
+
+ private:
+  int nstreams_;
+
+  // element rows indexed by atomic number, and whether any stream separates
+  // the element
+  std::vector<double> elem_rows_;
+  std::vector<bool> elem_used_;
+
+  // nuclide rows, sorted by nuclide
+  std::vector<int> nucs_;
+  std::vector<double> nuc_rows_;
+};
+
 /// Separations processes feed material into one or more streams containing
 /// specific elements and/or nuclides.  It uses mass-based efficiencies.
 ///
@@ -35,7 +75,9 @@ cyclus::Material::Ptr SepMaterial(std::map<int, double> effs,
 /// corresponding output inventory size/limit.  If the facility is unable to
 /// reduce its stocks by trading and hits this limit for any of its output
 /// streams, further processing/separations of feed material will halt until
-/// room is again available in the output streams.
+/// room is again available in the output streams.  If feed batches are
+/// separated one at a time, only batches that separate into a full stream
+/// are held back.
 class Separations
   : public cyclus::Facility,
     public cyclus::toolkit::Position {
@@ -187,6 +229,34 @@ class Separations
   }
   cyclus::toolkit::ResBuf<cyclus::Material> leftover;
 
+  #pragma cyclus var { \
+    "default": False, \
+    "userlevel": 10, \
+    "tooltip": "Whether to merge stored stream material before bidding", \
+    "doc": "If true, the material stored in each stream buffer and in the " \
+           "leftover buffer is merged into a single material before " \
+           "bidding, so each request receives one bid per stream regardless " \
+           "of how long material has been stored. Streams separated from a " \
+           "fixed feed have a single composition, so this only changes " \
+           "traded compositions if the feed composition varies.", \
+    "uilabel": "Coalesce Stream Inventories", \
+    "uitype": "bool"}
+  bool coalesce_streams;
+
+  #pragma cyclus var { \
+    "default": False, \
+    "userlevel": 10, \
+    "tooltip": "Whether to separate each feed batch on its own", \
+    "doc": "If true, feed batches are separated one at a time in the order " \
+           "they were received, up to the throughput, instead of being " \
+           "merged into a single material first. Space in each stream " \
+           "buffer is used up batch by batch and a batch is only held back " \
+           "by the streams it separates into, so one full stream doesn't " \
+           "stop batches that don't feed it from being processed.", \
+    "uilabel": "Separate Feed Batches", \
+    "uitype": "bool"}
+  bool separate_batches;
+
   #pragma cyclus var { \
     "alias": ["streams", "commod", ["info", "buf_size", ["efficiencies", "comp", "eff"]]], \
     "uitype": ["oneormore", "outcommodity", ["pair", "double", ["oneormore", "nuclide", "double"]]], \
@@ -208,10 +278,26 @@ class Separations
   std::map<std::string, std::pair<double, std::map<int, double> > > streams_;
 
   // custom SnapshotInv and InitInv and EnterNotify are used to persist this
-  // state var.
-  std::map<std::string, cyclus::toolkit::ResBuf<cyclus::Material> > streambufs;
+  // state var. Buffers are indexed parallel to stream_names_.
+  std::vector<cyclus::toolkit::ResBuf<cyclus::Material> > streambufs;
+
+  // stream names, their commodity-to-index table and their efficiencies
+  // compiled from streams_, in the same order
+  std::vector<std::string> stream_names_;
+  std::map<std::string, int> stream_index_;
+  SepMatrix sep_matrix_;
 
   void Record(std::string name, double val, std::string type);
+
+  /// Builds stream_names_, stream_index_ and one buffer per stream from
+  /// streams_. Buffers that already exist (e.g. from InitInv) are kept.
+  void IndexStreams_();
+
+  /// Separates feed batches one at a time (see separate_batches).
+  void SeparateBatches_();
+
+  /// Merges the materials in buf into one if coalesce_streams is set.
+  void Coalesce_(cyclus::toolkit::ResBuf<cyclus::Material>* buf);
 };
 
 }  // namespace cycamore
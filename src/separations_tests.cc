@@ -43,6 +43,59 @@ TEST(SeparationsTests, SepMaterial) {
   EXPECT_DOUBLE_EQ(0, mqsep.mass("Am242"));
 }
 
+TEST(SeparationsTests, SepMatrix) {
+  CompMap comp;
+  comp[id("U235")] = 10;
+  comp[id("U238")] = 90;
+  comp[id("Pu239")] = 1;
+  comp[id("Pu240")] = 2;
+  comp[id("Am241")] = 3;
+  comp[id("Am242")] = 2.8;
+  comp[id("Cs137")] = 5;
+  double qty = 50;
+  Composition::Ptr c = Composition::CreateFromMass(comp);
+  Material::Ptr mat = Material::CreateUntracked(qty, c);
+
+  std::vector<std::map<int, double> > effs(3);
+  effs[0][id("U")] = .7;
+  effs[0][id("Pu239")] = .2;
+  effs[1][id("Pu")] = .5;
+  effs[1][id("Am241")] = .4;
+  effs[2][id("Pu239")] = .3;
+  SepMatrix sm(effs);
+  ASSERT_EQ(3, sm.nstreams());
+
+  // element efficiencies are filled in for streams not naming the nuclide
+  EXPECT_TRUE(sm.Row(id("Cs137")) == NULL);
+  const double* row = sm.Row(id("Pu239"));
+  ASSERT_TRUE(row != NULL);
+  EXPECT_DOUBLE_EQ(.2, row[0]);
+  EXPECT_DOUBLE_EQ(.5, row[1]);
+  EXPECT_DOUBLE_EQ(.3, row[2]);
+  row = sm.Row(id("Pu240"));
+  ASSERT_TRUE(row != NULL);
+  EXPECT_DOUBLE_EQ(0, row[0]);
+  EXPECT_DOUBLE_EQ(.5, row[1]);
+  EXPECT_DOUBLE_EQ(0, row[2]);
+
+  std::vector<Material::Ptr> seps;
+  sm.Split(mat, &seps);
+  ASSERT_EQ(3, seps.size());
+  MatQuery mqorig(mat);
+  EXPECT_NEAR(.7 * (mqorig.mass("U235") + mqorig.mass("U238")) +
+              .2 * mqorig.mass("Pu239"), seps[0]->quantity(), 1e-12);
+
+  MatQuery mq0(seps[0]);
+  EXPECT_NEAR(.7 * mqorig.mass("U238"), mq0.mass("U238"), 1e-12);
+  EXPECT_NEAR(.2 * mqorig.mass("Pu239"), mq0.mass("Pu239"), 1e-12);
+  EXPECT_EQ(0, mq0.mass("Pu240"));
+  MatQuery mq1(seps[1]);
+  EXPECT_NEAR(.5 * mqorig.mass("Pu240"), mq1.mass("Pu240"), 1e-12);
+  EXPECT_NEAR(.4 * mqorig.mass("Am241"), mq1.mass("Am241"), 1e-12);
+  EXPECT_EQ(0, mq1.mass("Am242"));
+  MatQuery mq2(seps[2]);
+  EXPECT_NEAR(.3 * mqorig.mass("Pu239"), seps[2]->quantity(), 1e-12);
+}
 
 // Check that cumulative separations efficiency for a single nuclide of less than or equal to one does not trigger an error.
 TEST(SeparationsTests, SeparationEfficiency) {
@@ -281,6 +334,167 @@ TEST(SeparationsTests, SepMixElemAndNuclide) {
   EXPECT_DOUBLE_EQ(0, mq.mass("Pu240"));
 }
 
+// Check that stored stream material is offered as a single material when
+// coalescing, so a late request is met with one trade.
+TEST(SeparationsTests, CoalesceStreams) {
+  std::string config =
+      "<streams>"
+      "    <item>"
+      "        <commod>stream1</commod>"
+      "        <info>"
+      "            <buf_size>-1</buf_size>"
+      "            <efficiencies>"
+      "                <item><comp>U</comp> <eff>0.6</eff></item>"
+      "            </efficiencies>"
+      "        </info>"
+      "    </item>"
+      "</streams>"
+      ""
+      "<leftover_commod>waste</leftover_commod>"
+      "<throughput>10</throughput>"
+      "<feedbuf_size>100</feedbuf_size>"
+      "<feed_commods> <val>feed</val> </feed_commods>"
+      "<coalesce_streams>1</coalesce_streams>"
+     ;
+
+  CompMap m;
+  m[id("u235")] = 0.08;
+  m[id("u238")] = 0.9;
+  m[id("Pu239")] = .02;
+  Composition::Ptr c = Composition::CreateFromMass(m);
+
+  // separates on steps 1 to 5 before the sink asks for anything
+  int simdur = 6;
+  cyclus::MockSim sim(cyclus::AgentSpec(":cycamore:Separations"), config, simdur);
+  sim.AddSource("feed").recipe("recipe1").capacity(10).Finalize();
+  sim.AddSink("stream1").capacity(1000).start(5).Finalize();
+  sim.AddRecipe("recipe1", c);
+  int id = sim.Run();
+
+  std::vector<Cond> conds;
+  conds.push_back(Cond("SenderId", "==", id));
+  QueryResult qr = sim.db().Query("Transactions", &conds);
+  ASSERT_EQ(1, qr.rows.size());
+  Material::Ptr mat = sim.GetMaterial(qr.GetVal<int>("ResourceId"));
+  EXPECT_NEAR(5 * 10 * 0.98 * 0.6, mat->quantity(), 1e-9);
+}
+
+// Check that feed batches are separated on their own, so batches that don't
+// separate into a full stream keep being processed.
+TEST(SeparationsTests, SeparateBatches) {
+  std::string config =
+      "<streams>"
+      "    <item>"
+      "        <commod>pu</commod>"
+      "        <info>"
+      "            <buf_size>1</buf_size>"
+      "            <efficiencies>"
+      "                <item><comp>Pu</comp> <eff>1.0</eff></item>"
+      "            </efficiencies>"
+      "        </info>"
+      "    </item>"
+      "    <item>"
+      "        <commod>u</commod>"
+      "        <info>"
+      "            <buf_size>-1</buf_size>"
+      "            <efficiencies>"
+      "                <item><comp>U</comp> <eff>1.0</eff></item>"
+      "            </efficiencies>"
+      "        </info>"
+      "    </item>"
+      "</streams>"
+      ""
+      "<leftover_commod>waste</leftover_commod>"
+      "<throughput>100</throughput>"
+      "<feedbuf_size>100</feedbuf_size>"
+      "<feed_commods> <val>mox</val> <val>uox</val> </feed_commods>"
+      "<separate_batches>1</separate_batches>"
+     ;
+
+  CompMap mox;
+  mox[id("Pu239")] = 0.5;
+  mox[id("U238")] = 0.5;
+  CompMap uox;
+  uox[id("U238")] = 1;
+
+  int simdur = 4;
+  cyclus::MockSim sim(cyclus::AgentSpec(":cycamore:Separations"), config, simdur);
+  sim.AddSource("mox").recipe("mox").capacity(10).Finalize();
+  sim.AddSource("uox").recipe("uox").capacity(10).Finalize();
+  sim.AddRecipe("mox", Composition::CreateFromMass(mox));
+  sim.AddRecipe("uox", Composition::CreateFromMass(uox));
+  int id = sim.Run();
+
+  // the first mox batch is cut to fit the pu stream and later mox batches
+  // are held back, while every uox batch is separated
+  std::string sql =
+      "SELECT SUM(Value) FROM SeparationEvents"
+      " WHERE Event = 'Separated' AND Type = ?;";
+  cyclus::SqlStatement::Ptr stmt = sim.db().db().Prepare(sql);
+  stmt->BindText(1, "pu");
+  stmt->Step();
+  EXPECT_NEAR(1, stmt->GetDouble(0), 1e-9);
+
+  stmt = sim.db().db().Prepare(sql);
+  stmt->BindText(1, "u");
+  stmt->Step();
+  EXPECT_NEAR(1 + 3 * 10, stmt->GetDouble(0), 1e-9);
+}
+
+// Check that the part of a batch held back for a full stream keeps the
+// batch's composition and that only the rest is separated.
+TEST(SeparationsTests, SeparateBatchesHoldBack) {
+  std::string config =
+      "<streams>"
+      "    <item>"
+      "        <commod>pu</commod>"
+      "        <info>"
+      "            <buf_size>25</buf_size>"
+      "            <efficiencies>"
+      "                <item><comp>Pu</comp> <eff>1.0</eff></item>"
+      "            </efficiencies>"
+      "        </info>"
+      "    </item>"
+      "</streams>"
+      ""
+      "<leftover_commod>waste</leftover_commod>"
+      "<throughput>100</throughput>"
+      "<feedbuf_size>100</feedbuf_size>"
+      "<feed_commods> <val>mox</val> </feed_commods>"
+      "<separate_batches>1</separate_batches>"
+     ;
+
+  CompMap mox;
+  mox[id("Pu239")] = 0.5;
+  mox[id("U238")] = 0.5;
+
+  int simdur = 2;
+  cyclus::MockSim sim(cyclus::AgentSpec(":cycamore:Separations"), config, simdur);
+  sim.AddSource("mox").recipe("mox").capacity(100).Finalize();
+  sim.AddSink("waste").Finalize();
+  sim.AddRecipe("mox", Composition::CreateFromMass(mox));
+  sim.Run();
+
+  // half of the batch fits in the pu stream: 25 Pu + 25 U is held back, 25 Pu
+  // is separated and the remaining 25 U goes to leftovers
+  std::vector<Cond> conds;
+  conds.push_back(Cond("Commodity", "==", std::string("waste")));
+  QueryResult qr = sim.db().Query("Transactions", &conds);
+  ASSERT_EQ(1, qr.rows.size());
+  Material::Ptr m = sim.GetMaterial(qr.GetVal<int>("ResourceId"));
+  EXPECT_NEAR(25, m->quantity(), 1e-9);
+  MatQuery mq(m);
+  EXPECT_NEAR(0, mq.mass("Pu239"), 1e-9);
+
+  std::string sql =
+      "SELECT SUM(Value) FROM SeparationEvents"
+      " WHERE Event = 'Separated' AND Type = ?;";
+  cyclus::SqlStatement::Ptr stmt = sim.db().db().Prepare(sql);
+  stmt->BindText(1, "pu");
+  stmt->Step();
+  EXPECT_NEAR(25, stmt->GetDouble(0), 1e-9);
+}
+
 TEST(SeparationsTests, Retire) {
   std::string config =
       "<streams>"
@@ -1,5 +1,6 @@
 #! /usr/bin/env python3
 import os
+import time
 import uuid
 import sqlite3
 import platform
@@ -256,6 +257,117 @@ class TestGreedyPhysorSources(_PhysorSources):
     def setup_class(cls):
         return super(TestGreedyPhysorSources, cls).setup_class("../input/physor/greedy_2_Sources_3_Reactors.xml")
 
+class _TimedComparison(TestRegression):
+    """A base class for tests that compare a run against a reference run of a
+    related input.  Both runs are timed and their transaction counts and wall
+    times are printed.  Derived classes name the two runs with `ref_label` and
+    `label`.
+    """
+    @classmethod
+    def setup_class(cls, inf, ref_inf):
+        cls.ref_outf = str(uuid.uuid4()) + '.sqlite'
+        start = time.time()
+        run_cyclus("cyclus", os.getcwd(), ref_inf, cls.ref_outf)
+        cls.ref_walltime = time.time() - start
+        start = time.time()
+        super(_TimedComparison, cls).setup_class(inf)
+        cls.walltime = time.time() - start
+
+        conn = sqlite3.connect(cls.ref_outf)
+        conn.row_factory = sqlite3.Row
+        exc = conn.cursor().execute
+        cls.ref_agent_entry = exc('SELECT * FROM AgentEntry').fetchall()
+        cls.ref_transactions = exc('SELECT * FROM Transactions').fetchall()
+        cls.ref_rsrc_qtys = {x["ResourceId"]: x["Quantity"] for x in
+                             exc('SELECT * FROM Resources').fetchall()}
+        conn.close()
+        print("{0}: {1} transactions in {2:.3f} s".format(
+            cls.ref_label, len(cls.ref_transactions), cls.ref_walltime))
+        print("{0}: {1} transactions in {2:.3f} s".format(
+            cls.label, len(cls.transactions), cls.walltime))
+
+    @classmethod
+    def teardown_class(cls):
+        super(_TimedComparison, cls).teardown_class()
+        if os.path.isfile(cls.ref_outf):
+            os.remove(cls.ref_outf)
+
+class TestGreedyPhysorSourcesBatched(_TimedComparison):
+    """This class runs the 2_Sources_3_Reactor.xml scenario with reactors in
+    batch request mode and compares it against the per-assembly run.  Every
+    reactor must receive the same fuel mass on every time step in both modes,
+    with far fewer transactions when requesting a batch at a time.
+    """
+    ref_label = "per-assembly"
+    label = "batched"
+
+    @classmethod
+    def setup_class(cls):
+        super(TestGreedyPhysorSourcesBatched, cls).setup_class(
+            "../input/physor/greedy_2_Sources_3_Reactors_batched.xml",
+            "../input/physor/greedy_2_Sources_3_Reactors.xml")
+
+    def received(self, agent_entry, transactions, rsrc_qtys):
+        rx_id = self.find_ids(":cycamore:Reactor", agent_entry)
+        txs = np.zeros((len(rx_id), 5))
+        for tx in transactions:
+            if tx['ReceiverId'] in rx_id:
+                i = rx_id.index(tx['ReceiverId'])
+                txs[i, tx['Time']] += rsrc_qtys[tx['ResourceId']]
+        return txs
+
+    def test_received(self):
+        exp = self.received(self.ref_agent_entry, self.ref_transactions,
+                            self.ref_rsrc_qtys)
+        obs = self.received(self.agent_entry, self.transactions,
+                            self.rsrc_qtys)
+        assert_array_almost_equal(exp, obs)
+
+    def test_xaction_count(self):
+        assert len(self.transactions) < len(self.ref_transactions)
+
+class TestEnrichmentTailsBand(_TimedComparison):
+    """This class runs the tails_band.xml scenario, where tails pile up before
+    the tails sink is built, and compares it against the same run with every
+    tails material kept separate.  The tails sink must receive the same tails
+    on every time step whether or not tails are merged into assay bands, in
+    fewer transactions when the piled up tails are merged.
+    """
+    inf = "../input/enrichment/tails_band.xml"
+    ref_label = "separate tails"
+    label = "banded tails"
+
+    @classmethod
+    def setup_class(cls):
+        cls.ref_inf = str(uuid.uuid4()) + '.xml'
+        with open(cls.inf) as f:
+            xml = f.read()
+        with open(cls.ref_inf, 'w') as f:
+            f.write(xml.replace("<tails_band>0.0005</tails_band>", ""))
+        super(TestEnrichmentTailsBand, cls).setup_class(cls.inf, cls.ref_inf)
+
+    @classmethod
+    def teardown_class(cls):
+        super(TestEnrichmentTailsBand, cls).teardown_class()
+        if os.path.isfile(cls.ref_inf):
+            os.remove(cls.ref_inf)
+
+    def tails_received(self, transactions, rsrc_qtys):
+        txs = np.zeros(self.info[0]['Duration'])
+        for tx in transactions:
+            if tx['Commodity'] == 'ef_tails':
+                txs[tx['Time']] += rsrc_qtys[tx['ResourceId']]
+        return txs
+
+    def test_tails_received(self):
+        exp = self.tails_received(self.ref_transactions, self.ref_rsrc_qtys)
+        obs = self.tails_received(self.transactions, self.rsrc_qtys)
+        assert exp.sum() > 0
+        assert_array_almost_equal(exp, obs)
+
+    def test_xaction_count(self):
+        assert len(self.transactions) < len(self.ref_transactions)
+
 class TestDynamicCapacitated(TestRegression):
     """Tests dynamic capacity restraints involving changes in the number of
     source and sink facilities.